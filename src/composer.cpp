@@ -0,0 +1,913 @@
+#include "composer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <execution>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <OpenEXR/IlmImf/ImfArray.h>
+#include <OpenEXR/IlmImf/ImfNamespace.h>
+
+#include "compressionbenchmark.h"
+#include "exrio.h"
+#include "numa.h"
+#include "parser.h"
+#include "pipes.h"
+#include "pixelfunctions.h"
+#include "preflight.h"
+#include "sharding.h"
+#include "stringutils.h"
+
+#define CALCRESULT(in1, nodeType, in2) do { \
+                                        switch (nodeType) { \
+                                          case Parser::Node::ADD: \
+                                            for (int y = 0; y < resArray.height(); y++) { \
+                                              for (int x = 0; x < resArray.width(); x++) { \
+                                                resArray[y][x] = (in1) + (in2); \
+                                              } \
+                                            } \
+                                            break; \
+                                          case Parser::Node::SUB: \
+                                            for (int y = 0; y < resArray.height(); y++) { \
+                                              for (int x = 0; x < resArray.width(); x++) { \
+                                                resArray[y][x] = (in1) - (in2); \
+                                              } \
+                                            } \
+                                            break; \
+                                          case Parser::Node::MULT: \
+                                            for (int y = 0; y < resArray.height(); y++) { \
+                                              for (int x = 0; x < resArray.width(); x++) { \
+                                                resArray[y][x] = (in1) * (in2); \
+                                              } \
+                                            } \
+                                            break; \
+                                          case Parser::Node::DIV: \
+                                            for (int y = 0; y < resArray.height(); y++) { \
+                                              for (int x = 0; x < resArray.width(); x++) { \
+                                                resArray[y][x] = (in1) / (in2); \
+                                              } \
+                                            } \
+                                            break; \
+                                          default: \
+                                            throw runtime_error("unsupported operator in " + node->toString(patch)); \
+                                        } \
+                                       } while(0)  // Swallowing Semicolon
+
+
+using namespace std;
+namespace IMF = OPENEXR_IMF_NAMESPACE;
+using namespace OPENEXR_IMF_NAMESPACE;
+using namespace IMATH_NAMESPACE;
+
+struct CalcResult {
+    enum CalcResultType {INVALID, ARRAY, CONSTANT};
+    CalcResult() : type(INVALID), hasAlpha(false), singleChannel(false) {}
+    CalcResultType type;
+    // Arrays may be shared with the frame cache and must not be modified.
+    shared_ptr<const Array2D<float>> array;
+    bool hasAlpha;
+    // The array holds one value per pixel, computed from a selected channel
+    // ("matte.exr.A"). It takes the channels of the images it is combined with.
+    bool singleChannel;
+    // Display window of the inputs the array has been computed from.
+    Box2i displayWindow;
+    float constant;
+};
+
+// Replaces the wildcard in path by patch. Paths without wildcard are
+// returned unchanged.
+string applyPatch(const string& path, const string& patch, size_t numQuestionMarks) {
+    string res = path;
+    size_t wildCardLength = 1;
+    size_t wildCardPos = res.find("#");
+    if(wildCardPos == string::npos && numQuestionMarks != 0) {
+        wildCardPos = res.find(string(numQuestionMarks, '?'));
+        wildCardLength = numQuestionMarks;
+    }
+    if(wildCardPos != string::npos)
+        res.replace(wildCardPos, wildCardLength, patch);
+    return res;
+}
+
+// Returns the number of values per pixel of an array result.
+int channelCount(const CalcResult& res) {
+    return res.singleChannel ? 1 : res.hasAlpha ? 4 : 3;
+}
+
+// Converts the array of res to RGB(A). A single channel is copied to all
+// channels, a missing alpha channel is filled with 0 (fully transparent).
+void convertChannels(CalcResult& res, bool hasAlpha) {
+    if (!res.singleChannel && res.hasAlpha == hasAlpha)
+        return;
+    const int inputStride = channelCount(res);
+    const int stride = hasAlpha ? 4 : 3;
+    const Array2D<float>& input = *res.array;
+    const size_t numPixels = size_t(input.height()) * size_t(input.width() / inputStride);
+    shared_ptr<Array2D<float>> array = make_shared<Array2D<float>>(input.height(), input.width() / inputStride * stride);
+    const float* inputValues = input[0];
+    float* values = (*array)[0];
+    for (size_t i = 0; i < numPixels; i++) {
+        for (int c = 0; c < stride; c++) {
+            if (inputStride == 1)
+                values[i * stride + c] = inputValues[i];
+            else
+                values[i * stride + c] = c < inputStride ? inputValues[i * inputStride + c] : 0.0f;
+        }
+    }
+    res.array = array;
+    res.hasAlpha = hasAlpha;
+    res.singleChannel = false;
+}
+
+// If node only forwards the pixels of a single input (e.g. "in.exr * 1.0"),
+// returns that input node. Returns nullptr otherwise.
+const Parser::Node* findPassthroughInput(const Parser::Node* node) {
+    if (node->type == Parser::Node::INPUTFILEPATH)
+        return node->channel.empty() ? node : nullptr;
+    if (!node->left || !node->right)
+        return nullptr;
+    float value;
+    switch (node->type) {
+        case Parser::Node::ADD:
+            if (node->left->isConstant(value) && value == 0.0f)
+                return findPassthroughInput(node->right);
+            if (node->right->isConstant(value) && value == 0.0f)
+                return findPassthroughInput(node->left);
+            return nullptr;
+        case Parser::Node::MULT:
+            if (node->left->isConstant(value) && value == 1.0f)
+                return findPassthroughInput(node->right);
+            if (node->right->isConstant(value) && value == 1.0f)
+                return findPassthroughInput(node->left);
+            return nullptr;
+        case Parser::Node::SUB:
+            if (node->right->isConstant(value) && value == 0.0f)
+                return findPassthroughInput(node->left);
+            return nullptr;
+        case Parser::Node::DIV:
+            if (node->right->isConstant(value) && value == 1.0f)
+                return findPassthroughInput(node->left);
+            return nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+int Composer::compose(const ComposeOptions& options, ostream& out) {
+    // Resolves relative paths against the working directory of the job.
+    auto resolvePath = [&](const string& pathString) {
+        filesystem::path filePath(pathString);
+        if (options.workingDirectory.empty() || isPipePath(pathString) || filePath.is_absolute())
+            return pathString;
+        return (options.workingDirectory / filePath).string();
+    };
+
+    Parser p(options.expression);
+    if(!p.isValid()) {
+        out << "error parsing expression: " << p.getErrorMessage() << "\n";
+        return 1;
+    }
+    const vector<const Parser::Node*>& assignments = p.getAssignments();
+    vector<string> inputFilePaths;
+    // Input nodes and resolved output path of each assignment.
+    vector<vector<const Parser::Node*>> assignmentInputs(assignments.size());
+    vector<string> assignmentOutputs(assignments.size());
+    // Inputs that need an alpha channel, as it is selected (".A") or they
+    // are composited over another image. Checked during preflight.
+    set<const Parser::Node*> alphaInputs;
+    string requirementError;
+    // Adds the inputs the alpha channel of node is computed from to
+    // alphaInputs. Returns false if there are none.
+    std::function<bool(const Parser::Node* node)> requireAlpha = [&](const Parser::Node* node) {
+        if (node->type == Parser::Node::INPUTFILEPATH) {
+            // Selected channels take the channels of other images.
+            if (!node->channel.empty())
+                return false;
+            alphaInputs.insert(node);
+            return true;
+        }
+        // The alpha of over() is the alpha of its foreground.
+        if (node->type == Parser::Node::OVER)
+            return requireAlpha(node->arguments.front());
+        bool found = false;
+        if (node->left)
+            found = requireAlpha(node->left) || found;
+        if (node->right)
+            found = requireAlpha(node->right) || found;
+        for (const Parser::Node* argument : node->arguments)
+            found = requireAlpha(argument) || found;
+        return found;
+    };
+    // Inputs whose pixels are combined channel by channel must either all or
+    // none have an alpha channel. Each group of such inputs gets a number:
+    // the background of over() starts a new group, as its alpha may be
+    // missing. Selected channels belong to no group (-1).
+    map<const Parser::Node*, int> alphaGroups;
+    int numAlphaGroups = 0;
+    std::function<void(const Parser::Node* node, int group)> assignAlphaGroups = [&](const Parser::Node* node, int group) {
+        if (node->type == Parser::Node::INPUTFILEPATH)
+            alphaGroups[node] = node->channel.empty() ? group : -1;
+        if (node->left)
+            assignAlphaGroups(node->left, group);
+        if (node->right)
+            assignAlphaGroups(node->right, group);
+        for (size_t i = 0; i < node->arguments.size(); i++)
+            assignAlphaGroups(node->arguments[i], node->type == Parser::Node::OVER && i == 1 ? numAlphaGroups++ : group);
+    };
+    for (size_t i = 0; i < assignments.size(); i++) {
+        out << assignments[i]->toString("") << "\n";
+        std::function<void(const Parser::Node* node)> collectFunc;
+        collectFunc = [&](const Parser::Node* node) {
+            if (node->type == Parser::Node::INPUTFILEPATH) {
+                inputFilePaths.push_back(resolvePath(node->path));
+                assignmentInputs[i].push_back(node);
+                if (node->channel == "A")
+                    alphaInputs.insert(node);
+            }
+            else if (node->type == Parser::Node::OVER) {
+                if (!options.readAlpha)
+                    requirementError = "in " + node->toString("") + "\nover needs alpha channels, which are ignored with -rgb.";
+                else if (!requireAlpha(node->arguments.front()))
+                    requirementError = "in " + node->toString("") + "\nover needs an image with an alpha channel as foreground.";
+            }
+            else if (node->type == Parser::Node::OUTPUTFILEPATH) {
+                assignmentOutputs[i] = resolvePath(node->path);
+            }
+            if (node->left)
+                node->left->evaluate(collectFunc);
+            if (node->right)
+                node->right->evaluate(collectFunc);
+            for (const Parser::Node* argument : node->arguments)
+                argument->evaluate(collectFunc);
+        };
+        assignments[i]->evaluate(collectFunc);
+        assignAlphaGroups(assignments[i]->right, numAlphaGroups++);
+        if (assignmentInputs[i].empty()) {
+            out << "error: " << assignments[i]->toString("") << " has no input image.\n";
+            out << "use at least one input file on the right side of each assignment.\n";
+            return 1;
+        }
+        if (!requirementError.empty()) {
+            out << "error: " << requirementError << "\n";
+            return 1;
+        }
+    }
+    // Assignments to the same file are written as the parts of a single
+    // multi-part file, which requires naming each part.
+    struct OutputGroup {
+        string path;
+        vector<size_t> assignments;
+        bool multiPart = false;
+    };
+    vector<OutputGroup> outputGroups;
+    for (size_t i = 0; i < assignments.size(); i++) {
+        const string& part = assignments[i]->left->part;
+        auto group = std::find_if(outputGroups.begin(), outputGroups.end(), [&](const OutputGroup& g) { return g.path == assignmentOutputs[i]; });
+        if (group == outputGroups.end()) {
+            outputGroups.push_back(OutputGroup());
+            group = prev(outputGroups.end());
+            group->path = assignmentOutputs[i];
+        }
+        else if (part.empty() || !group->multiPart) {
+            out << "error: " << group->path << " is assigned more than once.\n";
+            out << "name the parts to write a multi-part file, e.g. " << imageName(group->path, "diffuse") << ".\n";
+            return 1;
+        }
+        for (size_t other : group->assignments) {
+            if (assignments[other]->left->part == part) {
+                out << "error: " << imageName(group->path, part) << " is assigned more than once.\n";
+                return 1;
+            }
+        }
+        group->assignments.push_back(i);
+        group->multiPart = group->multiPart || !part.empty();
+    }
+    const bool anyOutputIsPipe = std::any_of(outputGroups.begin(), outputGroups.end(), [](const OutputGroup& g) { return isPipePath(g.path); });
+    const bool anyInputIsPipe = std::any_of(inputFilePaths.begin(), inputFilePaths.end(), isPipePath);
+    if (options.patchRegion) {
+        for (const OutputGroup& group : outputGroups) {
+            if (group.multiPart || isPipePath(group.path)) {
+                out << "error: --roi-patch can only patch single-part output files, not " << group.path << ".\n";
+                return 1;
+            }
+        }
+    }
+    if (!options.allowPipes && (anyOutputIsPipe || anyInputIsPipe)) {
+        out << "error: pipes are not supported here, use files instead.\n";
+        return 1;
+    }
+    out << "Collecting files...\n";
+    set<std::string> patches;
+    size_t numQuestionMarks = 0;
+    for (int i = 0; i < inputFilePaths.size(); i++) {
+        string pathString = inputFilePaths[i];
+        if (isPipePath(pathString))
+            continue;
+        filesystem::path filePath(pathString);
+        filesystem::path folderPath = filePath.parent_path();
+        // Bare file names are relative to the current directory.
+        if (folderPath.empty())
+            folderPath = ".";
+        filesystem::path fileName = filePath.filename();
+        string fileNameString = fileName.string();
+        size_t numHashTags = std::count(fileNameString.begin(), fileNameString.end(), '#');
+        size_t countQuestionMarks = std::count(fileNameString.begin(), fileNameString.end(), '?');
+        if(numQuestionMarks != 0 && countQuestionMarks != 0 && numQuestionMarks != countQuestionMarks) {
+            out << "error: different number of question marks in input files.\n";
+            out << "use the same amount of question marks for each wildcard definition.\n";
+            return 1;
+        }
+        if(countQuestionMarks != 0)
+            numQuestionMarks = countQuestionMarks;
+        if(numQuestionMarks != 0 && numHashTags != 0) {
+            out << "error: cannot mix # and ? wildcards in same expression. use either one.\n";
+            return 1;
+        }
+        size_t numWildcards = numHashTags;
+        size_t searchStartPos = 0;
+        while(searchStartPos != string::npos && fileNameString.find('?', searchStartPos) != string::npos) {
+          numWildcards++;
+          searchStartPos = fileNameString.find('?', searchStartPos);
+          searchStartPos = fileNameString.find_first_not_of('?', searchStartPos);
+        }
+        if (numWildcards > 1) {
+            out << "error: multiple wildcards in " << filePath.string() << "\n";
+            out << "use only one wildcard per filename.\n";
+            return 1;
+        }
+        else if (numWildcards == 1) {
+            vector<string> nameSplit;
+            if(countQuestionMarks > 0) {
+              nameSplit = split(toLower(fileNameString), string(numQuestionMarks, '?'));
+            } else {
+              nameSplit = split(toLower(fileNameString), "#");
+            }
+            if (nameSplit.size() != 2) {
+                out << "error: cannot match the wildcard in " << filePath.string() << "\n";
+                return 1;
+            }
+            shared_ptr<const DirectoryIndex::FileNames> folderContents;
+            try {
+                folderContents = _directoryIndex.list(folderPath);
+            }
+            catch (const filesystem::filesystem_error& e) {
+                out << "error: cannot list " << folderPath.string() << ": " << e.what() << "\n";
+                return 1;
+            }
+            for (const string& otherFileName : *folderContents) {
+                size_t prefixPos = otherFileName.find(nameSplit[0]);
+                size_t postfixPos = otherFileName.find(nameSplit[1]);
+                if (prefixPos == 0 && postfixPos != string::npos) {
+                    string patch = otherFileName.substr(nameSplit[0].size(),
+                        otherFileName.size() - nameSplit[0].size() - nameSplit[1].size());
+                    if(numHashTags == 1 || (patch.length() == numQuestionMarks)) {
+                      patches.insert(patch);
+                    }
+                }
+            }
+        }
+        else {
+            if (!filesystem::exists(filePath)) {
+                out << "error: " << filePath.string() << " does not exist.\n";
+                return 1;
+            }
+        }
+    }
+    // Restrict the job to the requested frame range and shard.
+    if (patches.empty()) {
+        if (options.hasFrameRange)
+            out << "warning: --frames is ignored, the expression contains no wildcard.\n";
+        if (options.shardIndex != 0) {
+            out << "shard " << options.shardIndex << "/" << options.shardCount << ": nothing to do, the expression contains no wildcard.\n";
+            return 0;
+        }
+    } else if (options.hasFrameRange || options.shardCount > 1) {
+        size_t numNonNumeric = 0;
+        set<string> selected;
+        for (const string& patch : patches) {
+            long long frameNumber;
+            if (!parseFrameNumber(patch, frameNumber)) {
+                numNonNumeric++;
+            } else if (frameNumber >= options.firstFrame && frameNumber <= options.lastFrame) {
+                selected.insert(patch);
+            }
+        }
+        if (options.hasFrameRange) {
+            if (numNonNumeric > 0)
+                out << "warning: skipping " << numNonNumeric << " non-numeric wildcard matches outside of --frames range.\n";
+            patches.swap(selected);
+        }
+        vector<string> sortedPatches = sortPatches(patches);
+        vector<uintmax_t> weights;
+        if (options.shardByBytes) {
+            for (const string& patch : sortedPatches) {
+                uintmax_t bytes = 0;
+                for (const string& inputFilePath : inputFilePaths) {
+                    error_code ec;
+                    uintmax_t fileSize = filesystem::file_size(applyPatch(inputFilePath, patch, numQuestionMarks), ec);
+                    if (!ec)
+                        bytes += fileSize;
+                }
+                weights.push_back(bytes);
+            }
+        }
+        const size_t numFrames = sortedPatches.size();
+        vector<string> shard = selectShard(sortedPatches, weights, options.shardIndex, options.shardCount);
+        patches = set<string>(shard.begin(), shard.end());
+        if (options.shardCount > 1) {
+            out << "shard " << options.shardIndex << "/" << options.shardCount << ": " << shard.size() << " of " << numFrames << " frames";
+            if (!shard.empty())
+                out << " (" << shard.front() << " to " << shard.back() << ")";
+            out << "\n";
+        }
+        if (patches.empty()) {
+            out << "nothing to do, no frames selected.\n";
+            return 0;
+        }
+    }
+    if (anyOutputIsPipe && patches.size() > 1) {
+        for (const OutputGroup& group : outputGroups) {
+            if (isPipePath(group.path))
+                out << "error: " << group.path << " can only receive a single frame, but the wildcards match " << patches.size() << " frames.\n";
+        }
+        return 1;
+    }
+    //  Check if all necessary input files exist and output error otherwise:
+    vector<string> missingFiles;
+    vector<string> outputFilePaths;
+    for (string patch : patches) {
+        // find missing files.
+        for (int i = 0; i < inputFilePaths.size(); i++) {
+            string pathString = applyPatch(inputFilePaths[i], patch, numQuestionMarks);
+            filesystem::path filePath(pathString);
+            if (!isPipePath(pathString) && !filesystem::exists(filePath)) {
+                missingFiles.push_back(pathString);
+            }
+        }
+        // collect output file paths.
+        for (const OutputGroup& group : outputGroups)
+            outputFilePaths.push_back(applyPatch(group.path, patch, numQuestionMarks));
+    }
+    if(patches.empty()) {
+        for (const OutputGroup& group : outputGroups)
+            outputFilePaths.push_back(group.path);
+    }
+    if (!missingFiles.empty()) {
+        out << "error: Based on wildcards, the following files would be needed, but they don't exist:\n";
+        for (string path : missingFiles) {
+            out << path << "\n";
+        }
+        return 1;
+    }
+
+    // Input files opened during preflight, reused when decoding.
+    Preflight preflight;
+    // Decoded frames are only shared between jobs decoding them the same way.
+    string decodingSettings;
+    if (options.proxyFactor > 1) {
+        decodingSettings += "/proxy" + to_string(options.proxyFactor);
+        out << "proxy mode: reading inputs at 1/" << options.proxyFactor << " resolution.\n";
+    }
+    const Box2i region(V2i(options.regionMinX, options.regionMinY), V2i(options.regionMaxX, options.regionMaxY));
+    if (options.hasRegion) {
+        decodingSettings += "/roi" + windowString(region);
+        out << "region of interest: " << windowString(region) << "\n";
+    }
+    // Frames are computed in parallel, so their messages are formatted first
+    // and written whole, one at a time.
+    mutex outMutex;
+    auto report = [&](const string& message) {
+        lock_guard<mutex> lock(outMutex);
+        out << message;
+    };
+    // Throws if two array operands of node cannot be combined.
+    auto checkCompatible = [](const Parser::Node* node, const string& patch, const CalcResult& leftResult, const CalcResult& rightResult) {
+        const Array2D<float>& left = *leftResult.array;
+        const Array2D<float>& right = *rightResult.array;
+        if (leftResult.hasAlpha != rightResult.hasAlpha) {
+            throw runtime_error("in " + node->toString(patch) + "\n" +
+                "Alpha mismatch.\n" +
+                "Some inputs have Alpha channels, others do not. Consider using -rgb argument to ignore alpha channels altogether.");
+        }
+        if (left.width() / channelCount(leftResult) != right.width() / channelCount(rightResult) || left.height() != right.height()) {
+            throw runtime_error("in " + node->toString(patch) + "\n" +
+                "resolution mismatch. Left is " + to_string(left.width() / channelCount(leftResult)) + "x" + to_string(left.height()) +
+                " and right is " + to_string(right.width() / channelCount(rightResult)) + "x" + to_string(right.height()));
+        }
+    };
+    std::function<void(const Parser::Node*, const string& patch, CalcResult&)> evaluationFunc = [&](const Parser::Node* node, const string& patch, CalcResult& res) {
+        switch (node->type) {
+        case Parser::Node::INPUTFILEPATH: {
+                res.type = CalcResult::ARRAY;
+                string fileName = imageName(resolvePath(applyPatch(node->path, patch, numQuestionMarks)), node->part);
+                // Selecting the alpha channel needs it even if alpha is ignored otherwise.
+                const bool readAlpha = options.readAlpha || node->channel == "A";
+                const string decoding = (readAlpha ? "rgba" : "rgb") + decodingSettings;
+                FrameCache::Frame frame;
+                if (!_frameCache.lookup(fileName, decoding, frame)) {
+                    int width, height;
+                    shared_ptr<Array2D<float>> pixels = make_shared<Array2D<float>>();
+                    try {
+                        shared_ptr<InputImage> file = preflight.take(fileName);
+                        if (!file)
+                            file = openInputImage(fileName);
+                        if (options.hasRegion)
+                            frame.hasAlpha = readEXRRegion(*file, region, *pixels, readAlpha);
+                        else
+                            frame.hasAlpha = readEXR(*file, *pixels, width, height, readAlpha, options.proxyFactor);
+                        frame.displayWindow = file->header().displayWindow();
+                    }
+                    catch (...) {
+                        report("Failed to read " + fileName + "\n");
+                        throw;
+                    }
+                    frame.pixels = pixels;
+                    _frameCache.insert(fileName, decoding, frame);
+                }
+                res.displayWindow = frame.displayWindow;
+                if (node->channel.empty()) {
+                    res.array = frame.pixels;
+                    res.hasAlpha = frame.hasAlpha;
+                    return;
+                }
+                // The selected channel is kept as one value per pixel, which is
+                // combined with all channels of other images, e.g. as a matte.
+                const int inputStride = frame.hasAlpha ? 4 : 3;
+                const int channel = int(string("RGBA").find(node->channel));
+                if (channel >= inputStride)
+                    throw runtime_error(fileName + " has no " + node->channel + " channel.");
+                res.hasAlpha = false;
+                res.singleChannel = true;
+                const Array2D<float>& input = *frame.pixels;
+                const size_t numPixels = size_t(input.height()) * size_t(input.width() / inputStride);
+                shared_ptr<Array2D<float>> array = make_shared<Array2D<float>>(input.height(), input.width() / inputStride);
+                const float* inputValues = input[0];
+                float* values = (*array)[0];
+                for (size_t i = 0; i < numPixels; i++)
+                    values[i] = inputValues[i * inputStride + channel];
+                res.array = array;
+                return;
+            }
+            case Parser::Node::CONSTANT:
+                res.type = CalcResult::CONSTANT;
+                res.constant = node->constant;
+                return;
+            case Parser::Node::ADD:
+            case Parser::Node::SUB:
+            case Parser::Node::MULT:
+            case Parser::Node::DIV:
+            {
+                if (!node->left || !node->right)
+                    throw runtime_error("missing operand in " + node->toString(patch));
+                CalcResult leftResult, rightResult;
+                std::function<void(const Parser::Node*)> closed = [&](const Parser::Node* node) { evaluationFunc(node, patch, leftResult); };
+                node->left->evaluate(closed);
+                closed = [&](const Parser::Node* node) { evaluationFunc(node, patch, rightResult); };
+                node->right->evaluate(closed);
+                if (leftResult.type == CalcResult::INVALID || rightResult.type == CalcResult::INVALID)
+                    throw runtime_error("cannot evaluate " + node->toString(patch));
+                if (leftResult.type == CalcResult::CONSTANT && rightResult.type == CalcResult::CONSTANT) {
+                    res.type = CalcResult::CONSTANT;
+                    switch(node->type) {
+                        case Parser::Node::ADD:
+                            res.constant = leftResult.constant + rightResult.constant;
+                            break;
+                        case Parser::Node::SUB:
+                            res.constant = leftResult.constant - rightResult.constant;
+                            break;
+                        case Parser::Node::MULT:
+                            res.constant = leftResult.constant * rightResult.constant;
+                            break;
+                        case Parser::Node::DIV:
+                            res.constant = leftResult.constant / rightResult.constant;
+                            break;
+                        default:
+                            throw runtime_error("unsupported operator in " + node->toString(patch));
+                    }
+                }
+                else if (leftResult.type == CalcResult::ARRAY && rightResult.type == CalcResult::ARRAY) {
+                    // A selected channel takes the channels of the image it is combined with.
+                    if (leftResult.singleChannel && !rightResult.singleChannel)
+                        convertChannels(leftResult, rightResult.hasAlpha);
+                    else if (rightResult.singleChannel && !leftResult.singleChannel)
+                        convertChannels(rightResult, leftResult.hasAlpha);
+                    const Array2D<float>& left = *leftResult.array;
+                    const Array2D<float>& right = *rightResult.array;
+                    checkCompatible(node, patch, leftResult, rightResult);
+                    shared_ptr<Array2D<float>> array = make_shared<Array2D<float>>(left.height(), left.width());
+                    Array2D<float>& resArray = *array;
+                    res.type = CalcResult::ARRAY;
+                    res.hasAlpha = leftResult.hasAlpha;
+                    res.singleChannel = leftResult.singleChannel;
+                    res.displayWindow = leftResult.displayWindow;
+                    CALCRESULT(left[y][x], node->type, right[y][x]);
+                    res.array = array;
+                }
+                else if (leftResult.type == CalcResult::ARRAY) {
+                    // One Array operand and one constant operand.
+                    const Array2D<float>& left = *leftResult.array;
+                    shared_ptr<Array2D<float>> array = make_shared<Array2D<float>>(left.height(), left.width());
+                    Array2D<float>& resArray = *array;
+                    res.type = CalcResult::ARRAY;
+                    res.hasAlpha = leftResult.hasAlpha;
+                    res.singleChannel = leftResult.singleChannel;
+                    res.displayWindow = leftResult.displayWindow;
+                    const float c = rightResult.constant;
+                    CALCRESULT(left[y][x], node->type, c);
+                    res.array = array;
+                }
+                else {
+                    // One Array operand and one constant operand.
+                    const Array2D<float>& right = *rightResult.array;
+                    shared_ptr<Array2D<float>> array = make_shared<Array2D<float>>(right.height(), right.width());
+                    Array2D<float>& resArray = *array;
+                    res.type = CalcResult::ARRAY;
+                    res.hasAlpha = rightResult.hasAlpha;
+                    res.singleChannel = rightResult.singleChannel;
+                    res.displayWindow = rightResult.displayWindow;
+                    const float c = leftResult.constant;
+                    CALCRESULT(c, node->type, right[y][x]);
+                    res.array = array;
+                }
+                return;
+            }
+            case Parser::Node::MIN:
+            case Parser::Node::MAX:
+            case Parser::Node::CLAMP:
+            case Parser::Node::POW:
+            case Parser::Node::LERP:
+            case Parser::Node::OVER:
+            {
+                if (node->isConstant(res.constant)) {
+                    res.type = CalcResult::CONSTANT;
+                    return;
+                }
+                vector<CalcResult> arguments(node->arguments.size());
+                // The result takes the channels of the first image argument.
+                // Selected channels are only used if there is no image.
+                CalcResult* reference = nullptr;
+                for (size_t i = 0; i < arguments.size(); i++) {
+                    std::function<void(const Parser::Node*)> closed = [&](const Parser::Node* node) { evaluationFunc(node, patch, arguments[i]); };
+                    node->arguments[i]->evaluate(closed);
+                    if (arguments[i].type == CalcResult::INVALID)
+                        throw runtime_error("cannot evaluate " + node->toString(patch));
+                    if (arguments[i].type == CalcResult::ARRAY && (!reference || (reference->singleChannel && !arguments[i].singleChannel)))
+                        reference = &arguments[i];
+                }
+                if (node->type == Parser::Node::OVER) {
+                    if (arguments[0].type != CalcResult::ARRAY || arguments[0].singleChannel || !arguments[0].hasAlpha) {
+                        throw runtime_error("in " + node->toString(patch) + "\n" +
+                            "over needs an image with an alpha channel as foreground. Alpha channels are ignored with -rgb.");
+                    }
+                    reference = &arguments[0];
+                }
+                if (!reference)
+                    throw runtime_error("in " + node->toString(patch) + "\n" + "at least one argument must be an image.");
+                for (size_t i = 0; i < arguments.size(); i++) {
+                    if (arguments[i].type != CalcResult::ARRAY || &arguments[i] == reference)
+                        continue;
+                    if (arguments[i].singleChannel && !reference->singleChannel)
+                        convertChannels(arguments[i], reference->hasAlpha);
+                    // A background without alpha gets an alpha of 0, so the result
+                    // is RGBA with the alpha of the foreground.
+                    else if (node->type == Parser::Node::OVER && i == 1 && !arguments[i].hasAlpha)
+                        convertChannels(arguments[i], true);
+                    checkCompatible(node, patch, *reference, arguments[i]);
+                }
+                vector<PixelOperand> operands(arguments.size());
+                for (size_t i = 0; i < arguments.size(); i++) {
+                    if (arguments[i].type == CalcResult::ARRAY)
+                        operands[i].values = (*arguments[i].array)[0];
+                    else
+                        operands[i].constant = arguments[i].constant;
+                }
+                const Array2D<float>& referenceArray = *reference->array;
+                shared_ptr<Array2D<float>> array = make_shared<Array2D<float>>(referenceArray.height(), referenceArray.width());
+                applyPixelFunction(node->type, operands, (*array)[0],
+                                   size_t(referenceArray.height()) * size_t(referenceArray.width()), channelCount(*reference));
+                res.type = CalcResult::ARRAY;
+                res.hasAlpha = reference->hasAlpha;
+                res.singleChannel = reference->singleChannel;
+                res.displayWindow = reference->displayWindow;
+                res.array = array;
+                return;
+            }
+            default:
+                throw runtime_error("cannot evaluate " + node->toString(patch));
+        }
+    };
+    if (patches.empty())
+        patches.insert("");
+
+    // Validate all input headers up front, instead of failing on a broken
+    // frame after hours of computation. Inputs are checked per assignment,
+    // as the parts of a multi-part file may differ in resolution.
+    vector<vector<string>> inputsPerFrame;
+    vector<vector<int>> alphaGroupsPerFrame;
+    vector<string> frameNames;
+    set<string> uniqueInputs;
+    set<string> inputsNeedingAlpha;
+    for (const string& patch : patches) {
+        for (size_t i = 0; i < assignments.size(); i++) {
+            inputsPerFrame.push_back(vector<string>());
+            alphaGroupsPerFrame.push_back(vector<int>());
+            for (const Parser::Node* input : assignmentInputs[i]) {
+                inputsPerFrame.back().push_back(imageName(resolvePath(applyPatch(input->path, patch, numQuestionMarks)), input->part));
+                alphaGroupsPerFrame.back().push_back(alphaGroups[input]);
+                uniqueInputs.insert(inputsPerFrame.back().back());
+                if (alphaInputs.count(input))
+                    inputsNeedingAlpha.insert(inputsPerFrame.back().back());
+            }
+            frameNames.push_back(imageName(applyPatch(assignmentOutputs[i], patch, numQuestionMarks), assignments[i]->left->part));
+        }
+    }
+    out << "Checking " << uniqueInputs.size() << " input headers...\n";
+    if (!preflight.run(inputsPerFrame, alphaGroupsPerFrame, frameNames, options.readAlpha, inputsNeedingAlpha, options.hasRegion ? &region : nullptr, out))
+        return 1;
+    Compression compression = options.compression;
+    auto computeAssignment = [&](size_t assignment, const string& patch, CalcResult& res) {
+        std::function<void(const Parser::Node*)> closed = [&](const Parser::Node* node) { evaluationFunc(node, patch, res); };
+        assignments[assignment]->right->evaluate(closed);
+        if (res.type != CalcResult::ARRAY)
+            throw runtime_error(assignments[assignment]->toString(patch) + " does not produce an image.");
+        // A result computed from selected channels only is written as gray RGB.
+        if (res.singleChannel)
+            convertChannels(res, false);
+    };
+    // Outputs cover the whole result, or only the region of interest
+    // within the display window of the inputs.
+    auto outputWindows = [&](const CalcResult& res, Box2i& displayWindow, Box2i& dataWindow) {
+        const int stride = res.hasAlpha ? 4 : 3;
+        dataWindow = Box2i(V2i(0, 0), V2i(int(res.array->width() / stride) - 1, int(res.array->height()) - 1));
+        displayWindow = dataWindow;
+        if (options.hasRegion) {
+            dataWindow = region;
+            displayWindow = res.displayWindow;
+        }
+    };
+    // Frames computed on pinned NUMA workers encode their parts on the same
+    // thread, to keep all work of a frame on its node.
+    bool encodePartsInParallel = true;
+    auto writeGroup = [&](const OutputGroup& group, const string& targetFileName, const vector<CalcResult>& results) {
+        if (!group.multiPart) {
+            const CalcResult& res = results.front();
+            if (options.patchRegion) {
+                patchEXR(targetFileName.c_str(), (*res.array)[0], region, res.hasAlpha);
+                return;
+            }
+            Box2i displayWindow, dataWindow;
+            outputWindows(res, displayWindow, dataWindow);
+            writeEXR(targetFileName.c_str(), (*res.array)[0], displayWindow, dataWindow, res.hasAlpha, compression);
+            return;
+        }
+        vector<ImagePart> parts;
+        for (size_t i = 0; i < results.size(); i++) {
+            const CalcResult& res = results[i];
+            Box2i displayWindow, dataWindow;
+            outputWindows(res, displayWindow, dataWindow);
+            parts.push_back(ImagePart{assignments[group.assignments[i]]->left->part, (*res.array)[0],
+                                      displayWindow, dataWindow, res.hasAlpha});
+        }
+        writeMultiPartEXR(targetFileName.c_str(), parts, compression, encodePartsInParallel);
+    };
+    // Copies of a single input are written without decoding where the input
+    // chunks can be reused as they are. Not done when benchmarking
+    // compressions, as the point there is to re-encode, or for proxies
+    // and regions.
+    vector<const Parser::Node*> passthroughInputs(outputGroups.size(), nullptr);
+    for (size_t i = 0; i < outputGroups.size(); i++) {
+        const OutputGroup& group = outputGroups[i];
+        if (options.autoCompression == ComposeOptions::AUTO_OFF && options.proxyFactor == 1 && !options.hasRegion &&
+            !group.multiPart && !isPipePath(group.path))
+            passthroughInputs[i] = findPassthroughInput(assignments[group.assignments.front()]->right);
+    }
+    atomic<size_t> numCopied = 0;
+    // Errors are reported per output, so one broken frame does not abort the others.
+    atomic<size_t> numFailed = 0;
+    auto reportFailure = [&](const string& targetFileName, const exception& e) {
+        report("\nerror: failed to compute " + targetFileName + ": " + e.what() + "\n");
+    };
+    // With automatic compression, the compression is picked from the first
+    // output computed and used for the rest of the job.
+    bool chooseCompressionFromFirstResult = options.autoCompression != ComposeOptions::AUTO_OFF;
+    // Computes and writes all outputs of a frame. Returns false if any of them failed.
+    auto computeFrame = [&](const string& patch, const char* progressEnd) {
+        bool succeeded = true;
+        for (size_t i = 0; i < outputGroups.size(); i++) {
+            const OutputGroup& group = outputGroups[i];
+            string targetFileName = applyPatch(group.path, patch, numQuestionMarks);
+            report("computing " + targetFileName + progressEnd);
+            try {
+                if (const Parser::Node* passthroughInput = passthroughInputs[i]) {
+                    string inputFilePath = resolvePath(applyPatch(passthroughInput->path, patch, numQuestionMarks));
+                    string inputFileName = imageName(inputFilePath, passthroughInput->part);
+                    error_code ec;
+                    // Chunks are streamed from input to output, so they must be different files.
+                    if (!filesystem::equivalent(inputFilePath, targetFileName, ec)) {
+                        shared_ptr<InputImage> file = preflight.take(inputFileName);
+                        if (!file)
+                            file = openInputImage(inputFileName);
+                        if (copyEXRIfCompatible(*file, targetFileName.c_str(), options.readAlpha, compression)) {
+                            numCopied++;
+                            continue;
+                        }
+                    }
+                }
+                vector<CalcResult> results(group.assignments.size());
+                for (size_t j = 0; j < results.size(); j++)
+                    computeAssignment(group.assignments[j], patch, results[j]);
+                if (chooseCompressionFromFirstResult) {
+                    compression = chooseCompression(benchmarkCompressions(*results.front().array, results.front().hasAlpha), options.autoCompression, out);
+                    chooseCompressionFromFirstResult = false;
+                }
+                writeGroup(group, targetFileName, results);
+            }
+            catch (const exception& e) {
+                reportFailure(targetFileName, e);
+                succeeded = false;
+            }
+        }
+        return succeeded;
+    };
+    set<string>::const_iterator firstParallelPatch = patches.begin();
+    if (options.autoCompression != ComposeOptions::AUTO_OFF) {
+        // The first frame is computed on its own to pick the compression for the sequence.
+        if (!computeFrame(*firstParallelPatch++, "\n"))
+            return 1;
+    }
+    auto computeParallelFrame = [&](const string& patch) {
+        if (!computeFrame(patch, "               \r"))
+            numFailed++;
+    };
+    vector<NumaNode> nodes;
+    if (options.numa) {
+        nodes = numaNodes();
+        if (nodes.size() < 2)
+            out << "warning: --numa has no effect, the process can only run on a single NUMA node.\n";
+    }
+    if (nodes.size() >= 2) {
+        out << "distributing frames over " << nodes.size() << " NUMA nodes.\n";
+        const vector<string> parallelPatches(firstParallelPatch, patches.cend());
+        encodePartsInParallel = false;
+        const size_t numUnpinned = forEachOnNumaNodes(nodes, parallelPatches.size(), [&](size_t i) { computeParallelFrame(parallelPatches[i]); });
+        if (numUnpinned > 0)
+            out << "\nwarning: " << numUnpinned << " worker threads could not be pinned to their NUMA node.\n";
+    } else {
+        std::for_each(
+            std::execution::par,
+            firstParallelPatch,
+            patches.cend(),
+            computeParallelFrame);
+    }
+    if (numCopied > 0) {
+        out << "\ncopied " << numCopied << " of " << outputFilePaths.size() << " files without re-encoding.\n";
+    }
+    if (numFailed > 0) {
+        out << "\nerror: " << numFailed << " of " << patches.size() << " frames failed.\n";
+    }
+    if(options.verify) {
+        out << "verifying written images...\n";
+        Array2D<float> pixels;
+        int width, height;
+        bool verificationSuccessful = true;
+        for(int i=0; i<outputFilePaths.size(); i++) {
+            string pathString = outputFilePaths[i];
+            if (isPipePath(pathString))
+                continue;
+            out << pathString << "                             \r";
+            filesystem::path filePath(pathString);
+            if (!filesystem::exists(filePath)) {
+                out << "error: " << filePath.string() << " has not been written.\n";
+                verificationSuccessful = false;
+            }
+            else if(filesystem::file_size(pathString) == 0) {
+                out << "error: " << filePath.string() << " is 0 bytes.\n";
+                verificationSuccessful = false;
+            } else
+            {
+                try {
+                    readEXR(pathString.c_str(), pixels, width, height, true, out);
+                }
+                catch(...) {
+                    out << "error: verification failed. " << filePath.string() << " could not be read.\n";
+                    verificationSuccessful = false;
+                }
+            }
+        }
+        out << "\n";
+        if(verificationSuccessful) {
+            out << "verification succeeded, " <<  outputFilePaths.size() <<" files have been written.\n";
+        } else {
+            out << "verification failed.\n";
+        }
+    }
+    return numFailed > 0 ? 1 : 0;
+}
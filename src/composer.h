@@ -0,0 +1,24 @@
+#pragma once
+
+#include <ostream>
+
+#include "directoryindex.h"
+#include "framecache.h"
+#include "options.h"
+
+// Runs compose jobs. A single Composer can run several jobs concurrently,
+// in which case they share the decoded frame cache and directory index.
+class Composer {
+public:
+    // Creates a composer that keeps up to frameCacheBytes of decoded input
+    // frames in memory across jobs. 0 disables the frame cache.
+    explicit Composer(size_t frameCacheBytes = 0) : _frameCache(frameCacheBytes) {}
+
+    // Runs the job described by options, writing progress and errors to out.
+    // Returns the process exit code for the job.
+    int compose(const ComposeOptions& options, std::ostream& out);
+
+private:
+    FrameCache _frameCache;
+    DirectoryIndex _directoryIndex;
+};
@@ -0,0 +1,139 @@
+#include "compressionbenchmark.h"
+
+#include <algorithm>
+#undef NDEBUG  // keep assertions in release builds.
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <execution>
+#include <iomanip>
+
+#include <OpenEXR/IlmImf/ImfInputFile.h>
+
+#include "exrio.h"
+#include "exrstreams.h"
+
+using namespace std;
+using namespace OPENEXR_IMF_NAMESPACE;
+
+namespace {
+
+// Sampled bands are as high as the largest line block of the candidates
+// (PIZ) and start at a multiple of it, so every band is compressed the same
+// way as in the full frame.
+const int kBandHeight = 32;
+const int kNumBands = 8;
+
+// Assumed throughput of the storage outputs are written to and read back
+// from, e.g. a file server on 10 Gigabit Ethernet. auto:speed adds the time
+// to transfer the encoded bytes to the encode and decode times.
+const double kStorageBytesPerSecond = 500e6;
+
+// Only lossless compressions are candidates, so the choice never changes
+// the pixel values of the output.
+const Compression kCandidates[] = {
+    NO_COMPRESSION, RLE_COMPRESSION, ZIPS_COMPRESSION, ZIP_COMPRESSION, PIZ_COMPRESSION
+};
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+vector<CompressionBenchmark>
+benchmarkCompressions(const Array2D<float>& pixels, bool hasAlpha) {
+    const int stride = hasAlpha ? 4 : 3;
+    const int width = int(pixels.width() / stride);
+    const int height = int(pixels.height());
+
+    // Sample evenly spaced bands of scanlines, large frames would make the
+    // benchmark as expensive as writing several frames.
+    vector<int> sampleRows;
+    if (height <= kBandHeight * kNumBands) {
+        for (int y = 0; y < height; y++)
+            sampleRows.push_back(y);
+    } else {
+        for (int band = 0; band < kNumBands; band++) {
+            int bandStart = int((long long)(height - kBandHeight) * band / (kNumBands - 1));
+            bandStart -= bandStart % kBandHeight;
+            for (int y = bandStart; y < bandStart + kBandHeight; y++)
+                sampleRows.push_back(y);
+        }
+    }
+    const int sampleHeight = int(sampleRows.size());
+    Array2D<float> sample(sampleHeight, pixels.width());
+    for (int y = 0; y < sampleHeight; y++)
+        memcpy(sample[y], pixels[sampleRows[y]], sizeof(float) * pixels.width());
+
+    vector<CompressionBenchmark> benchmarks;
+    for (Compression compression : kCandidates)
+        benchmarks.push_back(CompressionBenchmark{compression, 0, 0.0, 0.0});
+
+    std::for_each(
+        std::execution::par,
+        benchmarks.begin(),
+        benchmarks.end(),
+        [&](CompressionBenchmark& benchmark)
+        {
+            MemoryOStream encoded;
+            auto start = chrono::steady_clock::now();
+            writeEXR(encoded, sample[0], width, sampleHeight, hasAlpha, benchmark.compression);
+            benchmark.encodeSeconds = secondsSince(start);
+            benchmark.bytes = encoded.data().size();
+
+            MemoryIStream stream(encoded.data().data(), encoded.data().size());
+            Array2D<float> decoded;
+            int decodedWidth, decodedHeight;
+            start = chrono::steady_clock::now();
+            InputFile file(stream);
+            readEXR(file, decoded, decodedWidth, decodedHeight, hasAlpha);
+            benchmark.decodeSeconds = secondsSince(start);
+        });
+    return benchmarks;
+}
+
+Compression
+chooseCompression(const vector<CompressionBenchmark>& benchmarks,
+                  ComposeOptions::AutoCompression target,
+                  ostream& out) {
+    assert(!benchmarks.empty());
+    size_t minBytes = benchmarks[0].bytes;
+    double minSeconds = benchmarks[0].encodeSeconds + benchmarks[0].decodeSeconds;
+    for (const CompressionBenchmark& b : benchmarks) {
+        minBytes = min(minBytes, b.bytes);
+        minSeconds = min(minSeconds, b.encodeSeconds + b.decodeSeconds);
+    }
+    minBytes = max<size_t>(minBytes, 1);
+    minSeconds = max(minSeconds, 1e-9);
+
+    // Lower is better. Balanced weighs relative size and relative time equally.
+    auto score = [&](const CompressionBenchmark& b) {
+        const double seconds = b.encodeSeconds + b.decodeSeconds;
+        switch (target) {
+            case ComposeOptions::AUTO_SIZE:
+                return double(b.bytes) + seconds / minSeconds * 1e-6;
+            case ComposeOptions::AUTO_SPEED:
+                // Written once and read back once.
+                return seconds + 2.0 * double(b.bytes) / kStorageBytesPerSecond;
+            case ComposeOptions::AUTO_BALANCED:
+            default:
+                return double(b.bytes) / minBytes * (seconds / minSeconds);
+        }
+    };
+
+    const CompressionBenchmark* best = &benchmarks[0];
+    out << "compression benchmark (bytes, encode ms, decode ms):\n";
+    for (const CompressionBenchmark& b : benchmarks) {
+        out << "  " << left << setw(12) << compressionName(b.compression) << right
+            << setw(12) << b.bytes
+            << setw(10) << fixed << setprecision(2) << b.encodeSeconds * 1000.0
+            << setw(10) << b.decodeSeconds * 1000.0 << defaultfloat << "\n";
+        if (score(b) < score(*best))
+            best = &b;
+    }
+    const char* targetName = target == ComposeOptions::AUTO_SIZE ? "size" :
+                             target == ComposeOptions::AUTO_SPEED ? "speed" : "balanced";
+    out << "using " << compressionName(best->compression) << " compression (optimized for " << targetName << ").\n";
+    return best->compression;
+}
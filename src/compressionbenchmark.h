@@ -0,0 +1,30 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include <OpenEXR/IlmImf/ImfArray.h>
+#include <OpenEXR/IlmImf/ImfCompression.h>
+#include <OpenEXR/IlmImf/ImfNamespace.h>
+
+#include "options.h"
+
+struct CompressionBenchmark {
+    OPENEXR_IMF_NAMESPACE::Compression compression;
+    size_t bytes;
+    double encodeSeconds;
+    double decodeSeconds;
+};
+
+// Encodes a sample of the interleaved RGB(A) pixels in memory with every
+// lossless compression (in parallel), then decodes it again and measures
+// the encoded size as well as encode and decode times.
+std::vector<CompressionBenchmark>
+benchmarkCompressions(const OPENEXR_IMF_NAMESPACE::Array2D<float>& pixels, bool hasAlpha);
+
+// Returns the compression that performs best for target and reports the
+// measurements and the decision to out.
+OPENEXR_IMF_NAMESPACE::Compression
+chooseCompression(const std::vector<CompressionBenchmark>& benchmarks,
+                  ComposeOptions::AutoCompression target,
+                  std::ostream& out);
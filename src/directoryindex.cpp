@@ -0,0 +1,29 @@
+#include "directoryindex.h"
+
+#include "filetimes.h"
+#include "stringutils.h"
+
+using namespace std;
+
+shared_ptr<const DirectoryIndex::FileNames> DirectoryIndex::list(const filesystem::path& folder) {
+    const string key = folder.string();
+    const filesystem::file_time_type lastWriteTime = filesystem::last_write_time(folder);
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto found = _entries.find(key);
+        if (found != _entries.end() && found->second.lastWriteTime == lastWriteTime)
+            return found->second.fileNames;
+    }
+
+    auto fileNames = make_shared<FileNames>();
+    for (const auto & entry : filesystem::directory_iterator(folder)) {
+        fileNames->push_back(toLower(entry.path().filename().string()));
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    if (!isRecentlyModified(lastWriteTime))
+        _entries[key] = Entry{lastWriteTime, fileNames};
+    else
+        _entries.erase(key);
+    return fileNames;
+}
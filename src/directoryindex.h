@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Thread safe cache of directory listings, used to resolve wildcards
+// without rescanning folders whose contents have not changed.
+class DirectoryIndex {
+public:
+    typedef std::vector<std::string> FileNames;
+
+    // Returns the lower case names of all files in folder. The listing is
+    // rescanned if the folder has been modified since the last call, or
+    // within a few seconds before it.
+    std::shared_ptr<const FileNames> list(const std::filesystem::path& folder);
+
+private:
+    struct Entry {
+        std::filesystem::file_time_type lastWriteTime;
+        std::shared_ptr<const FileNames> fileNames;
+    };
+
+    std::mutex _mutex;
+    std::unordered_map<std::string, Entry> _entries;
+};
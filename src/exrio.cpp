@@ -0,0 +1,628 @@
+#include "exrio.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <execution>
+#include <filesystem>
+#include <stdexcept>
+
+#include <OpenEXR/IlmImf/ImfChannelList.h>
+#include <OpenEXR/IlmImf/ImfHeader.h>
+#include <OpenEXR/IlmImf/ImfMultiPartOutputFile.h>
+#include <OpenEXR/IlmImf/ImfOutputFile.h>
+#include <OpenEXR/IlmImf/ImfOutputPart.h>
+#include <OpenEXR/IlmImf/ImfPartType.h>
+#include <OpenEXR/IlmImf/ImfTestFile.h>
+
+#include "exrstreams.h"
+#include "pipes.h"
+
+using namespace std;
+namespace IMF = OPENEXR_IMF_NAMESPACE;
+using namespace OPENEXR_IMF_NAMESPACE;
+using namespace IMATH_NAMESPACE;
+
+namespace {
+
+// Keeps the memory stream of a piped input alive as long as its file.
+template <class File>
+struct PipeInputFile {
+    PipeInputFile(const string &path, shared_ptr<const vector<char>> data)
+        : data(data), stream(data->data(), data->size(), path.c_str()), file(stream) {}
+    shared_ptr<const vector<char>> data;
+    MemoryIStream stream;
+    File file;
+};
+
+// Opens path as InputFile or MultiPartInputFile. Pipe paths are read into memory.
+template <class File>
+shared_ptr<File>
+openFile(const string &path)
+{
+    if (isPipePath(path)) {
+        shared_ptr<PipeInputFile<File>> pipeFile = make_shared<PipeInputFile<File>>(path, readPipe(path));
+        return shared_ptr<File>(pipeFile, &pipeFile->file);
+    }
+    return make_shared<File>(path.c_str());
+}
+
+}  // namespace
+
+string
+imageName(const string &path, const string &part)
+{
+    return part.empty() ? path : path + "[" + part + "]";
+}
+
+void
+splitImageName(const string &name, string &path, string &part)
+{
+    const size_t partPos = name.rfind('[');
+    if (name.empty() || name.back() != ']' || partPos == string::npos) {
+        path = name;
+        part.clear();
+        return;
+    }
+    path = name.substr(0, partPos);
+    part = name.substr(partPos + 1, name.size() - partPos - 2);
+}
+
+const Header &
+InputImage::header() const
+{
+    return _part ? _part->header() : _file->header();
+}
+
+void
+InputImage::setFrameBuffer(const FrameBuffer &frameBuffer)
+{
+    if (_part)
+        _part->setFrameBuffer(frameBuffer);
+    else
+        _file->setFrameBuffer(frameBuffer);
+}
+
+void
+InputImage::readPixels(int scanLine1, int scanLine2)
+{
+    if (_part)
+        _part->readPixels(scanLine1, scanLine2);
+    else
+        _file->readPixels(scanLine1, scanLine2);
+}
+
+void
+InputImage::copyPixelsTo(OutputFile &output)
+{
+    if (_part)
+        output.copyPixels(*_part);
+    else
+        output.copyPixels(*_file);
+}
+
+shared_ptr<InputImage>
+openInputImage(const string &name)
+{
+    string path, part;
+    splitImageName(name, path, part);
+    if (part.empty())
+        return make_shared<InputImage>(openFile<InputFile>(path));
+    shared_ptr<MultiPartInputFile> file = openFile<MultiPartInputFile>(path);
+    for (int i = 0; i < file->parts(); i++) {
+        const Header &header = file->header(i);
+        if (header.hasName() && header.name() == part)
+            return make_shared<InputImage>(file, i);
+    }
+    throw runtime_error(path + " has no part named " + part);
+}
+
+string
+windowString(const Box2i &window)
+{
+    return to_string(window.min.x) + "," + to_string(window.min.y) + "," +
+           to_string(window.max.x) + "," + to_string(window.max.y);
+}
+
+bool
+windowContains(const Box2i &outer,
+    const Box2i &inner)
+{
+    return inner.min.x >= outer.min.x && inner.min.y >= outer.min.y &&
+           inner.max.x <= outer.max.x && inner.max.y <= outer.max.y;
+}
+
+Header
+makeHeader(int width,
+    int height,
+    bool hasAlpha,
+    Compression compression)
+{
+    Header header(width, height);
+    header.channels().insert("R", Channel(IMF::FLOAT));
+    header.channels().insert("G", Channel(IMF::FLOAT));
+    header.channels().insert("B", Channel(IMF::FLOAT));
+    if (hasAlpha) {
+        header.channels().insert("A", Channel(IMF::FLOAT));
+    }
+    header.compression() = compression;
+    return header;
+}
+
+Header
+makeHeader(const Box2i &displayWindow,
+    const Box2i &dataWindow,
+    bool hasAlpha,
+    Compression compression)
+{
+    Header header = makeHeader(1, 1, hasAlpha, compression);
+    header.displayWindow() = displayWindow;
+    header.dataWindow() = dataWindow;
+    return header;
+}
+
+FrameBuffer
+makeFrameBuffer(const float *pixels,
+    int width,
+    bool hasAlpha)
+{
+    const int stride = hasAlpha ? 4 : 3;
+
+    FrameBuffer frameBuffer;
+
+    frameBuffer.insert("R",                      // name
+        Slice(IMF::FLOAT,                        // type
+        (char *)pixels,                          // base
+        sizeof(*pixels) * stride,                // xStride
+        sizeof(*pixels) * stride * width));      // yStride
+
+    frameBuffer.insert("G",                      // name
+        Slice(IMF::FLOAT,                        // type
+        (char *)(pixels + 1),                    // base
+        sizeof(*pixels) * stride,                // xStride
+        sizeof(*pixels) * stride * width));      // yStride
+
+    frameBuffer.insert("B",                      // name
+        Slice(IMF::FLOAT,                        // type
+        (char *)(pixels + 2),                    // base
+        sizeof(*pixels) * stride,                // xStride
+        sizeof(*pixels) * stride * width));      // yStride
+
+    if (hasAlpha) {
+        frameBuffer.insert("A",                  // name
+            Slice(IMF::FLOAT,                    // type
+            (char *)(pixels + 3),                // base
+            sizeof(*pixels) * stride,            // xStride
+            sizeof(*pixels) * stride * width));  // yStride
+    }
+    return frameBuffer;
+}
+
+FrameBuffer
+makeFrameBuffer(const float *pixels,
+    const Box2i &dataWindow,
+    bool hasAlpha)
+{
+    const int stride = hasAlpha ? 4 : 3;
+    const int width = dataWindow.max.x - dataWindow.min.x + 1;
+    // Slices are addressed in pixel coordinates, so the base is moved to (0,0).
+    return makeFrameBuffer(pixels - (dataWindow.min.x + ptrdiff_t(dataWindow.min.y) * width) * stride, width, hasAlpha);
+}
+
+void
+writeEXR(OStream &stream,
+    const float *pixels,
+    int width,
+    int height,
+    bool hasAlpha,
+    Compression compression)
+{
+    OutputFile file(stream, makeHeader(width, height, hasAlpha, compression));
+    file.setFrameBuffer(makeFrameBuffer(pixels, width, hasAlpha));
+    file.writePixels(height);
+}
+
+void
+writeEXR(const char fileName[],
+    const float *pixels,
+    const Box2i &displayWindow,
+    const Box2i &dataWindow,
+    bool hasAlpha,
+    Compression compression)
+{
+    if (isPipePath(fileName)) {
+        // OutputFile seeks back to write the line offsets, which pipes don't support.
+        MemoryOStream stream(fileName);
+        writeEXR(stream, pixels, displayWindow, dataWindow, hasAlpha, compression);
+        writePipe(fileName, stream.data());
+        return;
+    }
+    OutputFile file(fileName, makeHeader(displayWindow, dataWindow, hasAlpha, compression));
+    file.setFrameBuffer(makeFrameBuffer(pixels, dataWindow, hasAlpha));
+    file.writePixels(dataWindow.max.y - dataWindow.min.y + 1);
+}
+
+void
+writeEXR(OStream &stream,
+    const float *pixels,
+    const Box2i &displayWindow,
+    const Box2i &dataWindow,
+    bool hasAlpha,
+    Compression compression)
+{
+    OutputFile file(stream, makeHeader(displayWindow, dataWindow, hasAlpha, compression));
+    file.setFrameBuffer(makeFrameBuffer(pixels, dataWindow, hasAlpha));
+    file.writePixels(dataWindow.max.y - dataWindow.min.y + 1);
+}
+
+void
+patchEXR(const char fileName[],
+    const float *pixels,
+    const Box2i &region,
+    bool hasAlpha)
+{
+    bool tiled, deep, multiPart;
+    if (!isOpenExrFile(fileName, tiled, deep, multiPart))
+        throw runtime_error(string(fileName) + " is not an exr file");
+    if (tiled || deep || multiPart)
+        throw runtime_error("only single-part scanline files can be patched, " + string(fileName) + " is not one");
+    InputFile input(fileName);
+    const Header header = input.header();
+    const Box2i dataWindow = header.dataWindow();
+    if (!windowContains(dataWindow, region)) {
+        throw runtime_error("region " + windowString(region) + " is outside the data window " +
+                            windowString(dataWindow) + " of " + fileName);
+    }
+    const bool existingHasAlpha = header.channels().findChannel("A") != nullptr;
+    if (existingHasAlpha != hasAlpha) {
+        throw runtime_error(string(fileName) + (existingHasAlpha ? " has" : " has no") +
+                            " alpha channel, but the result " + (hasAlpha ? "has one." : "does not."));
+    }
+    // The file keeps its compression. Lossy ones would change the pixels
+    // outside of region when encoded again.
+    switch (header.compression()) {
+        case B44_COMPRESSION:
+        case B44A_COMPRESSION:
+        case DWAA_COMPRESSION:
+        case DWAB_COMPRESSION:
+            throw runtime_error(string(fileName) + " is compressed lossy, patching it would change all of its pixels");
+        default:
+            break;
+    }
+
+    // R, G, B(, A) are read as float for patching, all other channels are
+    // kept in their own type. Half channels are converted back exactly.
+    const int stride = hasAlpha ? 4 : 3;
+    const int width = dataWindow.max.x - dataWindow.min.x + 1;
+    const int height = dataWindow.max.y - dataWindow.min.y + 1;
+    Array2D<float> existing(height, width * stride);
+    FrameBuffer frameBuffer = makeFrameBuffer(existing[0], dataWindow, hasAlpha);
+    vector<vector<char>> otherChannels;
+    for (ChannelList::ConstIterator i = header.channels().begin(); i != header.channels().end(); ++i) {
+        const Channel &channel = i.channel();
+        if (channel.xSampling != 1 || channel.ySampling != 1)
+            throw runtime_error(string(fileName) + " has subsampled channel " + i.name() + ", which cannot be patched");
+        const string name = i.name();
+        if (name == "R" || name == "G" || name == "B" || name == "A")
+            continue;
+        const size_t pixelSize = channel.type == IMF::HALF ? 2 : 4;
+        otherChannels.push_back(vector<char>(pixelSize * width * height));
+        frameBuffer.insert(name,
+            Slice(channel.type,
+                otherChannels.back().data() - (dataWindow.min.x + ptrdiff_t(dataWindow.min.y) * width) * ptrdiff_t(pixelSize),
+                pixelSize,
+                pixelSize * width));
+    }
+    input.setFrameBuffer(frameBuffer);
+    input.readPixels(dataWindow.min.y, dataWindow.max.y);
+
+    const size_t regionWidth = size_t(region.max.x - region.min.x + 1) * stride;
+    for (int y = region.min.y; y <= region.max.y; y++) {
+        const float *source = pixels + (y - region.min.y) * regionWidth;
+        std::copy(source, source + regionWidth, &existing[y - dataWindow.min.y][(region.min.x - dataWindow.min.x) * stride]);
+    }
+
+    // The file is replaced only once completely written, so a failure
+    // leaves the original intact. Its header, including all attributes,
+    // is written unchanged.
+    const string temporaryFileName = string(fileName) + ".tmp";
+    {
+        OutputFile output(temporaryFileName.c_str(), header);
+        output.setFrameBuffer(frameBuffer);
+        output.writePixels(height);
+    }
+    filesystem::rename(temporaryFileName, fileName);
+}
+
+namespace {
+
+// Writes parts to target, a file name or an OStream.
+template <class Target>
+void
+writeParts(Target &target,
+    const vector<ImagePart> &parts,
+    Compression compression,
+    bool encodeInParallel)
+{
+    // OpenEXR serializes writing the parts of one file, so each part is
+    // encoded into memory first, on its own thread if encodeInParallel.
+    // The compressed chunks are then copied into the parts without
+    // decoding them again.
+    vector<MemoryOStream> encoded(parts.size());
+    auto encode = [&](const ImagePart &part)
+    {
+        writeEXR(encoded[&part - parts.data()], part.pixels, part.displayWindow, part.dataWindow, part.hasAlpha, compression);
+    };
+    if (encodeInParallel)
+        std::for_each(std::execution::par, parts.begin(), parts.end(), encode);
+    else
+        std::for_each(parts.begin(), parts.end(), encode);
+
+    vector<Header> headers;
+    for (const ImagePart &part : parts) {
+        headers.push_back(makeHeader(part.displayWindow, part.dataWindow, part.hasAlpha, compression));
+        headers.back().setName(part.name);
+        headers.back().setType(SCANLINEIMAGE);
+    }
+    // Parts may differ in resolution, shared attributes such as the display
+    // window are taken from the first part.
+    MultiPartOutputFile file(target, headers.data(), int(headers.size()), true);
+    for (size_t i = 0; i < parts.size(); i++) {
+        MemoryIStream stream(encoded[i].data().data(), encoded[i].data().size());
+        InputFile input(stream);
+        OutputPart output(file, int(i));
+        output.copyPixels(input);
+    }
+}
+
+// Reads every proxyFactor-th scanline of the data window of file and
+// averages groups of proxyFactor columns into pixels.
+template <class File>
+void
+readProxyPixels(File &file,
+    Array2D<float> &pixels,
+    int &width, int &height,
+    int stride,
+    int proxyFactor)
+{
+    const Box2i dw = file.header().dataWindow();
+    const int proxyWidth = (width + proxyFactor - 1) / proxyFactor;
+    const int proxyHeight = (height + proxyFactor - 1) / proxyFactor;
+
+    // A y stride of 0 decodes every scanline into the same row. Line blocks
+    // (e.g. 16 lines for ZIP, 32 for DWAA) that contain no sampled scanline
+    // are not decompressed at all.
+    vector<float> row(size_t(width) * stride);
+    const char *channelNames[] = {"R", "G", "B", "A"};
+    FrameBuffer frameBuffer;
+    for (int c = 0; c < stride; c++) {
+        frameBuffer.insert(channelNames[c],
+            Slice(IMF::FLOAT,
+                (char *)(row.data() + c - dw.min.x * stride),
+                sizeof(float) * stride,
+                0));
+    }
+    file.setFrameBuffer(frameBuffer);
+
+    pixels.resizeErase(proxyHeight, proxyWidth * stride);
+    for (int py = 0; py < proxyHeight; py++) {
+        const int y = dw.min.y + py * proxyFactor;
+        file.readPixels(y, y);
+        for (int px = 0; px < proxyWidth; px++) {
+            const int x0 = px * proxyFactor;
+            const int x1 = min(x0 + proxyFactor, width);
+            for (int c = 0; c < stride; c++) {
+                float sum = 0.0f;
+                for (int x = x0; x < x1; x++)
+                    sum += row[size_t(x) * stride + c];
+                pixels[py][px * stride + c] = sum / float(x1 - x0);
+            }
+        }
+    }
+    width = proxyWidth;
+    height = proxyHeight;
+}
+
+// Reads the data window of file, an InputFile or InputImage.
+// Returns true if result is RGBA, false if result is RGB.
+template <class File>
+bool
+readPixels(File &file,
+    Array2D<float> &pixels,
+    int &width, int &height,
+    bool readAlphaIfPresent,
+    int proxyFactor)
+{
+    Header header = file.header();
+    const Box2i dw = header.dataWindow();
+    width = dw.max.x - dw.min.x + 1;
+    height = dw.max.y - dw.min.y + 1;
+    const ChannelList channels = header.channels();
+    const bool hasAlpha = channels.findChannel("A") != nullptr;
+    const bool readAlpha = hasAlpha && readAlphaIfPresent;
+
+    const int stride = readAlpha ? 4 : 3;
+
+    if (proxyFactor > 1) {
+        readProxyPixels(file, pixels, width, height, stride, proxyFactor);
+        return readAlpha;
+    }
+
+    pixels.resizeErase(height, width * stride);
+
+    FrameBuffer frameBuffer;
+
+    frameBuffer.insert("R",                            // name
+        Slice(IMF::FLOAT,                              // type
+            (char *)(&pixels[0][0] -                   // base
+            dw.min.x * stride -
+            dw.min.y * stride * width),
+            sizeof(pixels[0][0]) * stride,             // xStride
+            sizeof(pixels[0][0]) * stride * width));   // yStride
+
+    frameBuffer.insert("G",                            // name
+        Slice(IMF::FLOAT,                              // type
+            (char *)(&pixels[0][1] -                   // base
+            dw.min.x * stride -
+            dw.min.y * stride * width),
+            sizeof(pixels[0][0]) * stride,              // xStride
+            sizeof(pixels[0][0]) * stride * width));    // yStride
+
+    frameBuffer.insert("B",                             // name
+        Slice(IMF::FLOAT,                               // type
+            (char *)(&pixels[0][2] -                    // base
+            dw.min.x * stride -
+            dw.min.y * stride * width),
+            sizeof(pixels[0][0]) * stride,              // xStride
+            sizeof(pixels[0][0]) * stride * width));    // yStride
+
+    if (readAlpha) {
+        frameBuffer.insert("A",                         // name
+            Slice(IMF::FLOAT,                           // type
+                (char *)(&pixels[0][3] -                // base
+                dw.min.x * stride -
+                dw.min.y * stride * width),
+                sizeof(pixels[0][0]) * stride,          // xStride
+                sizeof(pixels[0][0]) * stride * width));// yStride
+    }
+
+    file.setFrameBuffer(frameBuffer);
+    file.readPixels(dw.min.y, dw.max.y);
+    return readAlpha;
+}
+
+}  // namespace
+
+void
+writeMultiPartEXR(const char fileName[],
+    const vector<ImagePart> &parts,
+    Compression compression,
+    bool encodeInParallel)
+{
+    if (isPipePath(fileName)) {
+        MemoryOStream stream(fileName);
+        writeMultiPartEXR(stream, parts, compression, encodeInParallel);
+        writePipe(fileName, stream.data());
+        return;
+    }
+    writeParts(fileName, parts, compression, encodeInParallel);
+}
+
+void
+writeMultiPartEXR(OStream &stream,
+    const vector<ImagePart> &parts,
+    Compression compression,
+    bool encodeInParallel)
+{
+    writeParts(stream, parts, compression, encodeInParallel);
+}
+
+bool
+readEXR(InputFile &file,
+    Array2D<float> &pixels,
+    int &width, int &height,
+    bool readAlphaIfPresent)
+{
+    return readPixels(file, pixels, width, height, readAlphaIfPresent, 1);
+}
+
+bool
+readEXR(InputImage &image,
+    Array2D<float> &pixels,
+    int &width, int &height,
+    bool readAlphaIfPresent,
+    int proxyFactor)
+{
+    return readPixels(image, pixels, width, height, readAlphaIfPresent, proxyFactor);
+}
+
+bool
+readEXRRegion(InputImage &image,
+    const Box2i &region,
+    Array2D<float> &pixels,
+    bool readAlphaIfPresent)
+{
+    const Header &header = image.header();
+    const Box2i dw = header.dataWindow();
+    if (!windowContains(dw, region)) {
+        throw runtime_error("region " + windowString(region) + " is outside the data window " + windowString(dw));
+    }
+    const bool readAlpha = readAlphaIfPresent && header.channels().findChannel("A") != nullptr;
+    const int stride = readAlpha ? 4 : 3;
+
+    // Scanlines are always decoded across the whole data window, so the
+    // rows of the region are read into a band which is then cropped.
+    const int width = dw.max.x - dw.min.x + 1;
+    const int bandHeight = region.max.y - region.min.y + 1;
+    vector<float> band(size_t(width) * bandHeight * stride);
+    const char *channelNames[] = {"R", "G", "B", "A"};
+    FrameBuffer frameBuffer;
+    for (int c = 0; c < stride; c++) {
+        frameBuffer.insert(channelNames[c],
+            Slice(IMF::FLOAT,
+                (char *)(band.data() + c - dw.min.x * stride - ptrdiff_t(region.min.y) * width * stride),
+                sizeof(float) * stride,
+                sizeof(float) * stride * width));
+    }
+    image.setFrameBuffer(frameBuffer);
+    image.readPixels(region.min.y, region.max.y);
+
+    const int regionWidth = region.max.x - region.min.x + 1;
+    pixels.resizeErase(bandHeight, regionWidth * stride);
+    for (int y = 0; y < bandHeight; y++) {
+        const float *row = band.data() + (size_t(y) * width + region.min.x - dw.min.x) * stride;
+        std::copy(row, row + regionWidth * stride, pixels[y]);
+    }
+    return readAlpha;
+}
+
+bool
+readEXR(const char fileName[],
+    Array2D<float> &pixels,
+    int &width, int &height,
+    bool readAlphaIfPresent,
+    ostream &out)
+{
+    try {
+        shared_ptr<InputImage> image = openInputImage(fileName);
+        return readEXR(*image, pixels, width, height, readAlphaIfPresent);
+    }
+    catch (...)
+    {
+        out << "Failed to read " << fileName << "\n";
+        throw;
+    }
+}
+
+
+bool
+copyEXRIfCompatible(InputImage &image,
+    const char outputFileName[],
+    bool readAlphaIfPresent,
+    Compression compression)
+{
+    const Header& header = image.header();
+    if (header.hasTileDescription() ||
+        header.compression() != compression ||
+        header.lineOrder() != INCREASING_Y) {
+        return false;
+    }
+    // The output must be exactly what decoding and writing would produce.
+    const Box2i dw = header.dataWindow();
+    if (dw.min.x != 0 || dw.min.y != 0) {
+        return false;
+    }
+    const bool hasAlpha = header.channels().findChannel("A") != nullptr;
+    if (hasAlpha && !readAlphaIfPresent) {
+        return false;
+    }
+    const int width = dw.max.x - dw.min.x + 1;
+    const int height = dw.max.y - dw.min.y + 1;
+    Header outputHeader = makeHeader(width, height, hasAlpha, compression);
+    if (!(header.channels() == outputHeader.channels())) {
+        return false;
+    }
+
+    OutputFile outputFile(outputFileName, outputHeader);
+    image.copyPixelsTo(outputFile);
+    return true;
+}
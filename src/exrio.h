@@ -0,0 +1,199 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <OpenEXR/IlmImf/ImfArray.h>
+#include <OpenEXR/IlmImf/ImfCompression.h>
+#include <OpenEXR/IlmImf/ImfFrameBuffer.h>
+#include <OpenEXR/IlmImf/ImfHeader.h>
+#include <OpenEXR/IlmImf/ImfInputFile.h>
+#include <OpenEXR/IlmImf/ImfInputPart.h>
+#include <OpenEXR/IlmImf/ImfIO.h>
+#include <OpenEXR/IlmImf/ImfMultiPartInputFile.h>
+#include <OpenEXR/IlmImf/ImfNamespace.h>
+#include <OpenEXR/IlmImf/ImfOutputFile.h>
+
+// Input images are named by their path, followed by "[part]" for a named
+// part of a multi-part file, e.g. "aovs.exr[diffuse]".
+std::string
+imageName(const std::string &path, const std::string &part);
+
+// Splits an image name into path and part. part is empty for whole files.
+void
+splitImageName(const std::string &name, std::string &path, std::string &part);
+
+// A whole file or a single part of a multi-part file opened for reading.
+class InputImage {
+public:
+    explicit InputImage(std::shared_ptr<OPENEXR_IMF_NAMESPACE::InputFile> file)
+        : _file(file) {}
+    InputImage(std::shared_ptr<OPENEXR_IMF_NAMESPACE::MultiPartInputFile> file, int partNumber)
+        : _multiPartFile(file), _part(std::make_unique<OPENEXR_IMF_NAMESPACE::InputPart>(*file, partNumber)) {}
+
+    const OPENEXR_IMF_NAMESPACE::Header &header() const;
+    void setFrameBuffer(const OPENEXR_IMF_NAMESPACE::FrameBuffer &frameBuffer);
+    void readPixels(int scanLine1, int scanLine2);
+
+    // Copies the compressed pixel data to output without decoding it.
+    void copyPixelsTo(OPENEXR_IMF_NAMESPACE::OutputFile &output);
+
+private:
+    std::shared_ptr<OPENEXR_IMF_NAMESPACE::InputFile> _file;
+    std::shared_ptr<OPENEXR_IMF_NAMESPACE::MultiPartInputFile> _multiPartFile;
+    std::unique_ptr<OPENEXR_IMF_NAMESPACE::InputPart> _part;
+};
+
+// Opens the image with the given name (see imageName) for reading. Pipe
+// paths (see pipes.h) are read into memory. Throws if the file cannot be
+// read or has no part of that name.
+std::shared_ptr<InputImage>
+openInputImage(const std::string &name);
+
+// Formats a window as "minX,minY,maxX,maxY", the syntax of --roi.
+std::string
+windowString(const IMATH_NAMESPACE::Box2i &window);
+
+// Returns true if inner lies completely inside outer.
+bool
+windowContains(const IMATH_NAMESPACE::Box2i &outer,
+    const IMATH_NAMESPACE::Box2i &inner);
+
+// Returns the header for a 32bit float RGB(A) output.
+OPENEXR_IMF_NAMESPACE::Header
+makeHeader(int width,
+    int height,
+    bool hasAlpha,
+    OPENEXR_IMF_NAMESPACE::Compression compression);
+
+OPENEXR_IMF_NAMESPACE::Header
+makeHeader(const IMATH_NAMESPACE::Box2i &displayWindow,
+    const IMATH_NAMESPACE::Box2i &dataWindow,
+    bool hasAlpha,
+    OPENEXR_IMF_NAMESPACE::Compression compression);
+
+// Returns a frame buffer for interleaved RGB(A) pixels with the given width.
+OPENEXR_IMF_NAMESPACE::FrameBuffer
+makeFrameBuffer(const float *pixels,
+    int width,
+    bool hasAlpha);
+
+// Same as above for pixels covering dataWindow.
+OPENEXR_IMF_NAMESPACE::FrameBuffer
+makeFrameBuffer(const float *pixels,
+    const IMATH_NAMESPACE::Box2i &dataWindow,
+    bool hasAlpha);
+
+// Writes interleaved RGB(A) pixels as 32bit float exr to stream.
+void
+writeEXR(OPENEXR_IMF_NAMESPACE::OStream &stream,
+    const float *pixels,
+    int width,
+    int height,
+    bool hasAlpha,
+    OPENEXR_IMF_NAMESPACE::Compression compression = OPENEXR_IMF_NAMESPACE::ZIP_COMPRESSION);
+
+// Same as above for pixels covering dataWindow, stored with the given
+// display window. Pipe paths (see pipes.h) are encoded in memory and
+// written once complete.
+void
+writeEXR(const char fileName[],
+    const float *pixels,
+    const IMATH_NAMESPACE::Box2i &displayWindow,
+    const IMATH_NAMESPACE::Box2i &dataWindow,
+    bool hasAlpha,
+    OPENEXR_IMF_NAMESPACE::Compression compression);
+
+void
+writeEXR(OPENEXR_IMF_NAMESPACE::OStream &stream,
+    const float *pixels,
+    const IMATH_NAMESPACE::Box2i &displayWindow,
+    const IMATH_NAMESPACE::Box2i &dataWindow,
+    bool hasAlpha,
+    OPENEXR_IMF_NAMESPACE::Compression compression);
+
+// Replaces the R, G, B(, A) values within region of the existing file
+// fileName by interleaved RGB(A) pixels covering region. The file is
+// decoded, patched and written to a temporary file which then replaces it.
+// Header, compression and all other channels are kept. Throws if the file
+// is not a single-part scanline file, is compressed lossy, has subsampled
+// channels, region is not inside its data window or its alpha channel
+// does not match.
+void
+patchEXR(const char fileName[],
+    const float *pixels,
+    const IMATH_NAMESPACE::Box2i &region,
+    bool hasAlpha);
+
+// One image written as a named part of a multi-part file.
+struct ImagePart {
+    std::string name;
+    const float *pixels;  // interleaved RGB(A), covering dataWindow.
+    IMATH_NAMESPACE::Box2i displayWindow;
+    IMATH_NAMESPACE::Box2i dataWindow;
+    bool hasAlpha;
+};
+
+// Writes images as the parts of a single multi-part exr file. The parts
+// are encoded in parallel, or all on the calling thread if
+// encodeInParallel is false. Pipe paths (see pipes.h) are written once
+// complete.
+void
+writeMultiPartEXR(const char fileName[],
+    const std::vector<ImagePart> &parts,
+    OPENEXR_IMF_NAMESPACE::Compression compression,
+    bool encodeInParallel = true);
+
+void
+writeMultiPartEXR(OPENEXR_IMF_NAMESPACE::OStream &stream,
+    const std::vector<ImagePart> &parts,
+    OPENEXR_IMF_NAMESPACE::Compression compression,
+    bool encodeInParallel = true);
+
+// Reads the data window of file into interleaved RGB(A) pixels.
+// Returns true if result is RGBA, false if result is RGB.
+bool
+readEXR(OPENEXR_IMF_NAMESPACE::InputFile &file,
+    OPENEXR_IMF_NAMESPACE::Array2D<float> &pixels,
+    int &width, int &height,
+    bool readAlphaIfPresent);
+
+// Same as above for image. With a proxyFactor above 1, only every
+// proxyFactor-th scanline is decoded and groups of proxyFactor columns are
+// averaged, so the result has 1/proxyFactor of the resolution (rounded up).
+bool
+readEXR(InputImage &image,
+    OPENEXR_IMF_NAMESPACE::Array2D<float> &pixels,
+    int &width, int &height,
+    bool readAlphaIfPresent,
+    int proxyFactor = 1);
+
+// Reads the pixels of image within region (inclusive pixel coordinates)
+// into interleaved RGB(A) pixels, decoding only the scanlines of region.
+// Throws if region is not inside the data window of image.
+bool
+readEXRRegion(InputImage &image,
+    const IMATH_NAMESPACE::Box2i &region,
+    OPENEXR_IMF_NAMESPACE::Array2D<float> &pixels,
+    bool readAlphaIfPresent);
+
+// Same as readEXR above for the named image (see imageName) at full
+// resolution, reporting images that cannot be read to out before rethrowing.
+bool
+readEXR(const char fileName[],
+    OPENEXR_IMF_NAMESPACE::Array2D<float> &pixels,
+    int &width, int &height,
+    bool readAlphaIfPresent,
+    std::ostream &out);
+
+// If the scanline image can be written with the given alpha
+// setting and compression without changing its pixels, its compressed
+// chunks are copied to outputFileName without decoding. Returns false and
+// writes nothing otherwise.
+bool
+copyEXRIfCompatible(InputImage &image,
+    const char outputFileName[],
+    bool readAlphaIfPresent,
+    OPENEXR_IMF_NAMESPACE::Compression compression);
@@ -0,0 +1,29 @@
+#include "exrstreams.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+void MemoryOStream::write(const char c[], int n) {
+    if (_pos + n > _data.size())
+        _data.resize(size_t(_pos + n));
+    memcpy(_data.data() + _pos, c, size_t(n));
+    _pos += n;
+}
+
+bool MemoryIStream::read(char c[], int n) {
+    if (_pos + n > _size)
+        throw runtime_error(string("unexpected end of file ") + fileName());
+    memcpy(c, _data + _pos, size_t(n));
+    _pos += n;
+    return _pos < _size;
+}
+
+char* MemoryIStream::readMemoryMapped(int n) {
+    if (_pos + n > _size)
+        throw runtime_error(string("unexpected end of file ") + fileName());
+    char* result = const_cast<char*>(_data + _pos);
+    _pos += n;
+    return result;
+}
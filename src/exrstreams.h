@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <OpenEXR/IlmImf/ImfInt64.h>
+#include <OpenEXR/IlmImf/ImfIO.h>
+#include <OpenEXR/IlmImf/ImfNamespace.h>
+
+// Output stream collecting an exr file in memory.
+class MemoryOStream : public OPENEXR_IMF_NAMESPACE::OStream {
+public:
+    explicit MemoryOStream(const char fileName[] = "memory") : OStream(fileName), _pos(0) {}
+
+    void write(const char c[], int n) override;
+    OPENEXR_IMF_NAMESPACE::Int64 tellp() override { return _pos; }
+    void seekp(OPENEXR_IMF_NAMESPACE::Int64 pos) override { _pos = pos; }
+
+    const std::vector<char>& data() const { return _data; }
+
+private:
+    std::vector<char> _data;
+    OPENEXR_IMF_NAMESPACE::Int64 _pos;
+};
+
+// Input stream reading an exr file from memory. The data must outlive the stream.
+class MemoryIStream : public OPENEXR_IMF_NAMESPACE::IStream {
+public:
+    MemoryIStream(const char* data, size_t size, const char fileName[] = "memory")
+        : IStream(fileName), _data(data), _size(size), _pos(0) {}
+
+    bool isMemoryMapped() const override { return true; }
+    bool read(char c[], int n) override;
+    char* readMemoryMapped(int n) override;
+    OPENEXR_IMF_NAMESPACE::Int64 tellg() override { return _pos; }
+    void seekg(OPENEXR_IMF_NAMESPACE::Int64 pos) override { _pos = pos; }
+
+private:
+    const char* _data;
+    size_t _size;
+    OPENEXR_IMF_NAMESPACE::Int64 _pos;
+};
@@ -0,0 +1,18 @@
+#include "filetimes.h"
+
+#include <chrono>
+
+using namespace std;
+
+namespace {
+
+// File servers may store modification times with a granularity of up to
+// 2 seconds, so a change shortly after a file or folder has been read can
+// keep its time (and, without compression, a frame's size).
+const chrono::seconds kTimestampMargin(5);
+
+}  // namespace
+
+bool isRecentlyModified(filesystem::file_time_type lastWriteTime) {
+    return lastWriteTime >= filesystem::file_time_type::clock::now() - kTimestampMargin;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <filesystem>
+
+// Returns true if a file or folder last written at lastWriteTime has been
+// modified within the last few seconds. Its contents may then still change
+// without changing its modification time, so they must not be cached.
+bool isRecentlyModified(std::filesystem::file_time_type lastWriteTime);
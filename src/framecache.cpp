@@ -0,0 +1,77 @@
+#include "framecache.h"
+
+#include <system_error>
+
+#include "exrio.h"
+#include "filetimes.h"
+
+using namespace std;
+
+string FrameCache::makeKey(const string& name, const string& decoding) {
+    return decoding + ":" + name;
+}
+
+bool FrameCache::stat(const string& name, filesystem::file_time_type& lastWriteTime, uintmax_t& fileSize) {
+    string path, part;
+    splitImageName(name, path, part);
+    error_code ec;
+    lastWriteTime = filesystem::last_write_time(path, ec);
+    if (ec)
+        return false;
+    fileSize = filesystem::file_size(path, ec);
+    return !ec;
+}
+
+bool FrameCache::lookup(const string& name, const string& decoding, Frame& frame) {
+    if (_capacityBytes == 0)
+        return false;
+    filesystem::file_time_type lastWriteTime;
+    uintmax_t fileSize;
+    if (!stat(name, lastWriteTime, fileSize))
+        return false;
+
+    lock_guard<mutex> lock(_mutex);
+    auto found = _index.find(makeKey(name, decoding));
+    if (found == _index.end())
+        return false;
+    list<Entry>::iterator it = found->second;
+    if (it->lastWriteTime != lastWriteTime || it->fileSize != fileSize) {
+        // file has been modified since it was cached.
+        evict(it);
+        return false;
+    }
+    _entries.splice(_entries.begin(), _entries, it);
+    frame = it->frame;
+    return true;
+}
+
+void FrameCache::insert(const string& name, const string& decoding, const Frame& frame) {
+    if (_capacityBytes == 0 || !frame.pixels)
+        return;
+    const size_t sizeBytes = size_t(frame.pixels->height()) * size_t(frame.pixels->width()) * sizeof(float);
+    if (sizeBytes > _capacityBytes)
+        return;
+    filesystem::file_time_type lastWriteTime;
+    uintmax_t fileSize;
+    if (!stat(name, lastWriteTime, fileSize))
+        return;
+    if (isRecentlyModified(lastWriteTime))
+        return;
+
+    const string key = makeKey(name, decoding);
+    lock_guard<mutex> lock(_mutex);
+    auto found = _index.find(key);
+    if (found != _index.end())
+        evict(found->second);
+    while (_sizeBytes + sizeBytes > _capacityBytes && !_entries.empty())
+        evict(prev(_entries.end()));
+    _entries.push_front(Entry{key, frame, lastWriteTime, fileSize, sizeBytes});
+    _index[key] = _entries.begin();
+    _sizeBytes += sizeBytes;
+}
+
+void FrameCache::evict(list<Entry>::iterator it) {
+    _sizeBytes -= it->sizeBytes;
+    _index.erase(it->key);
+    _entries.erase(it);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <OpenEXR/IlmImf/ImfArray.h>
+#include <OpenEXR/IlmImf/ImfHeader.h>
+#include <OpenEXR/IlmImf/ImfNamespace.h>
+
+// Thread safe least-recently-used cache of decoded input files.
+// Entries are invalidated when the file on disk changes.
+class FrameCache {
+public:
+    struct Frame {
+        std::shared_ptr<const OPENEXR_IMF_NAMESPACE::Array2D<float>> pixels;
+        bool hasAlpha = false;
+        IMATH_NAMESPACE::Box2i displayWindow;
+    };
+
+    // Creates a cache holding at most capacityBytes of pixel data.
+    // A capacity of 0 disables caching.
+    explicit FrameCache(size_t capacityBytes) : _capacityBytes(capacityBytes), _sizeBytes(0) {}
+
+    // Returns true and sets frame if the image (see imageName in exrio.h)
+    // has been decoded with the same settings and its file has not changed
+    // since. decoding describes the settings that change the decoded pixels,
+    // such as alpha handling and resolution, e.g. "rgba".
+    bool lookup(const std::string& name, const std::string& decoding, Frame& frame);
+
+    // Adds a decoded frame, evicting least recently used frames as needed.
+    // Frames of files modified within the last few seconds are not added, as
+    // further changes may not alter their modification time.
+    void insert(const std::string& name, const std::string& decoding, const Frame& frame);
+
+private:
+    struct Entry {
+        std::string key;
+        Frame frame;
+        std::filesystem::file_time_type lastWriteTime;
+        std::uintmax_t fileSize;
+        size_t sizeBytes;
+    };
+
+    static std::string makeKey(const std::string& name, const std::string& decoding);
+    // Gets the modification time and size of the file holding the image.
+    static bool stat(const std::string& name, std::filesystem::file_time_type& lastWriteTime, std::uintmax_t& fileSize);
+    void evict(std::list<Entry>::iterator it);
+
+    std::mutex _mutex;
+    std::list<Entry> _entries;  // most recently used first.
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+    const size_t _capacityBytes;
+    size_t _sizeBytes;
+};
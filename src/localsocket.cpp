@@ -0,0 +1,158 @@
+#include "localsocket.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <system_error>
+
+#ifdef _WIN32
+#include <afunix.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+#ifdef _WIN32
+const LocalSocket::Handle kInvalidHandle = INVALID_SOCKET;
+
+void closeHandle(LocalSocket::Handle handle) { closesocket(handle); }
+
+void initializeSockets() {
+    static once_flag initialized;
+    call_once(initialized, []() {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+    });
+}
+#else
+const LocalSocket::Handle kInvalidHandle = -1;
+
+void closeHandle(LocalSocket::Handle handle) { ::close(handle); }
+
+void initializeSockets() {}
+#endif
+
+bool makeAddress(const string& path, sockaddr_un& address, string& errorMessage) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        errorMessage = "socket path is too long: " + path;
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+}  // namespace
+
+LocalSocket::LocalSocket() : _handle(kInvalidHandle) {}
+
+LocalSocket::~LocalSocket() { close(); }
+
+LocalSocket::LocalSocket(LocalSocket&& other) : _handle(other._handle) {
+    other._handle = kInvalidHandle;
+}
+
+LocalSocket& LocalSocket::operator=(LocalSocket&& other) {
+    if (this != &other) {
+        close();
+        _handle = other._handle;
+        other._handle = kInvalidHandle;
+    }
+    return *this;
+}
+
+bool LocalSocket::isValid() const { return _handle != kInvalidHandle; }
+
+void LocalSocket::close() {
+    if (isValid()) {
+        closeHandle(_handle);
+        _handle = kInvalidHandle;
+    }
+}
+
+bool LocalSocket::listen(const string& path, string& errorMessage) {
+    initializeSockets();
+    close();
+    sockaddr_un address;
+    if (!makeAddress(path, address, errorMessage))
+        return false;
+    if (filesystem::exists(path)) {
+        // Refuse to take over the socket of a server that is still running.
+        LocalSocket probe;
+        string ignored;
+        if (probe.connect(path, ignored)) {
+            errorMessage = "a server is already listening on " + path;
+            return false;
+        }
+        error_code ec;
+        filesystem::remove(path, ec);
+    }
+    _handle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!isValid()) {
+        errorMessage = "failed to create socket";
+        return false;
+    }
+    if (::bind(_handle, (const sockaddr*)&address, sizeof(address)) != 0) {
+        errorMessage = "failed to bind socket to " + path;
+        close();
+        return false;
+    }
+    if (::listen(_handle, SOMAXCONN) != 0) {
+        errorMessage = "failed to listen on " + path;
+        close();
+        return false;
+    }
+    return true;
+}
+
+LocalSocket LocalSocket::accept() {
+    return LocalSocket(::accept(_handle, nullptr, nullptr));
+}
+
+bool LocalSocket::connect(const string& path, string& errorMessage) {
+    initializeSockets();
+    close();
+    sockaddr_un address;
+    if (!makeAddress(path, address, errorMessage))
+        return false;
+    _handle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!isValid()) {
+        errorMessage = "failed to create socket";
+        return false;
+    }
+    if (::connect(_handle, (const sockaddr*)&address, sizeof(address)) != 0) {
+        errorMessage = "failed to connect to " + path;
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool LocalSocket::sendAll(const char* data, size_t size) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;  // report disconnects instead of raising SIGPIPE.
+#else
+    const int flags = 0;
+#endif
+    while (size > 0) {
+        const int chunk = int(min<size_t>(size, 1 << 20));
+        const auto sent = ::send(_handle, data, chunk, flags);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+long long LocalSocket::receive(char* data, size_t size) {
+    const int chunk = int(min<size_t>(size, 1 << 20));
+    return ::recv(_handle, data, chunk, 0);
+}
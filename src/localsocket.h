@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#endif
+
+// Minimal wrapper around a Unix domain stream socket. On Windows this uses
+// the AF_UNIX support available since Windows 10 version 1803.
+class LocalSocket {
+public:
+#ifdef _WIN32
+    typedef SOCKET Handle;
+#else
+    typedef int Handle;
+#endif
+
+    LocalSocket();
+    ~LocalSocket();
+    LocalSocket(LocalSocket&& other);
+    LocalSocket& operator=(LocalSocket&& other);
+    LocalSocket(const LocalSocket&) = delete;
+    LocalSocket& operator=(const LocalSocket&) = delete;
+
+    // Binds to path and starts listening for connections. A stale socket file
+    // left behind by a previous server is replaced.
+    bool listen(const std::string& path, std::string& errorMessage);
+
+    // Blocks until a client connects. Returns an invalid socket on error.
+    LocalSocket accept();
+
+    // Connects to a server listening on path.
+    bool connect(const std::string& path, std::string& errorMessage);
+
+    // Sends all size bytes of data. Returns false if the peer disconnected.
+    bool sendAll(const char* data, size_t size);
+
+    // Reads up to size bytes into data. Returns the number of bytes read,
+    // 0 if the peer closed the connection and a negative value on error.
+    long long receive(char* data, size_t size);
+
+    bool isValid() const;
+    void close();
+
+private:
+    explicit LocalSocket(Handle handle) : _handle(handle) {}
+    Handle _handle;
+};
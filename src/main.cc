@@ -1,74 +1,15 @@
-#include <algorithm>
-#undef NDEBUG  // keep assertions in release builds.
-#include <cassert>
-#include <exception>
-#include <execution>
+#include <cstdlib>
 #include <iostream>
-#include <map>
-#include <set>
 #include <string>
 #include <vector>
-#include <filesystem>
-
-#include <OpenEXR/IlmImf/ImfArray.h>
-#include <OpenEXR/IlmImf/ImfChannelList.h>
-#include <OpenEXR/IlmImf/ImfOutputFile.h>
-#include <OpenEXR/IlmImf/ImfInputFile.h>
-#include <OpenEXR/IlmImf/ImfNamespace.h>
 
+#include "composer.h"
+#include "options.h"
 #include "parser.h"
-#include "stringutils.h"
-
-#define CALCRESULT(in1, nodeType, in2) do { \
-                                        switch (nodeType) { \
-                                          case Parser::Node::ADD: \
-                                            for (int y = 0; y < res.array.height(); y++) { \
-                                              for (int x = 0; x < res.array.width(); x++) { \
-                                                res.array[y][x] = (in1) + (in2); \
-                                              } \
-                                            } \
-                                            break; \
-                                          case Parser::Node::SUB: \
-                                            for (int y = 0; y < res.array.height(); y++) { \
-                                              for (int x = 0; x < res.array.width(); x++) { \
-                                                res.array[y][x] = (in1) - (in2); \
-                                              } \
-                                            } \
-                                            break; \
-                                          case Parser::Node::MULT: \
-                                            for (int y = 0; y < res.array.height(); y++) { \
-                                              for (int x = 0; x < res.array.width(); x++) { \
-                                                res.array[y][x] = (in1) * (in2); \
-                                              } \
-                                            } \
-                                            break; \
-                                          case Parser::Node::DIV: \
-                                            for (int y = 0; y < res.array.height(); y++) { \
-                                              for (int x = 0; x < res.array.width(); x++) { \
-                                                res.array[y][x] = (in1) / (in2); \
-                                              } \
-                                            } \
-                                            break; \
-                                          default: \
-                                            assert(false); \
-                                        } \
-                                       } while(0)  // Swallowing Semicolon
-
+#include "pipes.h"
+#include "server.h"
 
 using namespace std;
-using namespace std::placeholders;
-namespace IMF = OPENEXR_IMF_NAMESPACE;
-using namespace OPENEXR_IMF_NAMESPACE;
-using namespace IMATH_NAMESPACE;
-
-struct CalcResult {
-    enum CalcResultType {INVALID, ARRAY, CONSTANT};
-    CalcResult() : type(INVALID) {}
-    CalcResultType type;
-    Array2D<float> array;
-    bool hasAlpha;
-    float constant;
-};
 
 void displayHelp() {
     cout << "Use to compose multiple exr files.\n";
@@ -84,6 +25,13 @@ void displayHelp() {
     cout << "You can also use constants. Example:\n";
     cout << "OpenExrComposer.exe \"signed_normals.exr = (unsigned_normals.exr - 0.5) * 2.0\"\n";
     cout << "\n";
+    cout << "Functions:\n";
+    cout << "min(a, b), max(a, b), clamp(x, low, high), pow(base, exponent), lerp(a, b, t) and over(foreground, background)\n";
+    cout << "(premultiplied, foreground needs an alpha channel, background may be RGB) work per channel on images and constants.\n";
+    cout << "A single channel of an input is selected with .R, .G, .B or .A and used for all channels of the images it is\n";
+    cout << "combined with, RGB or RGBA, e.g. as a matte:\n";
+    cout << "OpenExrComposer.exe \"comp_#.exr = clamp(lerp(plate_#.exr, grade_#.exr, matte_#.exr.A), 0, 1)\"\n";
+    cout << "\n";
     cout << "Compression options:\n";
     cout << "By default, 16 line ZIP compression is used to store the output.\n";
     cout << "To use a different compression, use -c argument or --compression argument to specify the compression.\n";
@@ -98,137 +46,70 @@ void displayHelp() {
     cout << "B44A        : lossy 4-by-4 pixel block compression, flat fields are compressed more\n";
     cout << "DWAA        : lossy DCT based compression, in blocks of 32 scanlines. More efficient for partial buffer access\n";
     cout << "DWAB        : lossy DCT based compression, in blocks of 256 scanlines. More efficient space wise and faster to decode full frames than DWAA. (recommended for minimal file size)\n";
+    cout << "auto        : benchmark the lossless compressions on the first frame and use the best one for the sequence.\n";
+    cout << "              auto:size picks the smallest output, auto:speed the fastest encode + decode time\n";
+    cout << "              including storage I/O (assuming 500 MB/s),\n";
+    cout << "              auto:balanced (same as auto) the best product of relative size and relative time.\n";
     cout << "\n";
     cout << "Alpha options:\n";
     cout << "By default, if one of the input files has an alpha channel, then all input files must have an alpha channel\n";
     cout << "and the output will have an alpha channel too. Use -rgb or --rgb argument to ignore alpha channels.\n\n";
+    cout << "Proxy mode:\n";
+    cout << "Add --proxy N to read only every Nth scanline of the inputs and average every N columns, for fast previews\n";
+    cout << "at 1/N resolution. Example:\n";
+    cout << "OpenExrComposer.exe \"preview_#.exr = diffuse_#.exr + specular_#.exr\" --proxy 4\n\n";
+    cout << "Region of interest:\n";
+    cout << "Add --roi x0,y0,x1,y1 to only decode and compute the pixels within that region (inclusive pixel coordinates).\n";
+    cout << "The output only contains the region, unless --roi-patch is added to patch it into the existing output files, which keep their channels, attributes and compression. Example:\n";
+    cout << "OpenExrComposer.exe \"beauty_#.exr = diffuse_#.exr + specular_#.exr\" --roi 0,1800,4095,2159 --roi-patch\n\n";
+    cout << "NUMA:\n";
+    cout << "On machines with several NUMA nodes (e.g. dual-socket), add --numa to pin one worker thread per processor to its node\n";
+    cout << "and compute each frame entirely on one node, so its buffers are allocated in the node's local memory.\n\n";
     cout << "Verification:\n";
-    cout << "Add the -v or --verify argument to verify that all output files have been written and are valid exr files.";
+    cout << "Add the -v or --verify argument to verify that all output files have been written and are valid exr files.\n\n";
+    cout << "Multi-part files:\n";
+    cout << "Separate several assignments with ;. Assignments to the same file name its parts with [part], and are written\n";
+    cout << "as parts of a single multi-part file. Inputs can read a named part the same way. Example:\n";
+    cout << "OpenExrComposer.exe \"aovs_#.exr[diffuse] = diffuse_#.exr * 2; aovs_#.exr[specular] = render_#.exr[specular]\"\n\n";
+    cout << "Pipes:\n";
+    cout << "Use pipe: instead of a file to read an input from standard input or write the output to standard output,\n";
+    cout << "or pipe:N for file descriptor N. The output can also be given as -. Example:\n";
+    cout << "exrgenerate | OpenExrComposer.exe \"- = pipe: * 0.5\" | exrdisplay\n\n";
+    cout << "Render farm distribution:\n";
+    cout << "Use --frames first-last to only process wildcard matches that are frame numbers within the range.\n";
+    cout << "Use --shard i/N to split the matched frames into N contiguous parts and only process part i (0 <= i < N).\n";
+    cout << "By default all shards get the same number of frames. Add --shard-by bytes to balance them by the size of their input files instead.\n";
+    cout << "Example:\n";
+    cout << "OpenExrComposer.exe \"beauty_#.exr = diffuse_#.exr + specular_#.exr\" --frames 1001-3000 --shard 3/20 --shard-by bytes\n\n";
+    cout << "Server mode:\n";
+    cout << "To avoid startup costs for many small jobs, a persistent composer can be started with\n";
+    cout << "OpenExrComposer.exe --serve <socket path> [--cache-size <MB>] [--jobs <N>]\n";
+    cout << "It keeps up to --cache-size MB of decoded input frames in memory (default 4096) and runs up to --jobs jobs at once (default 1).\n";
+    cout << "Jobs are sent to the server by adding --server <socket path> to the usual arguments. Example:\n";
+    cout << "OpenExrComposer.exe \"output.exr = input.exr\" --compression DWAB --server composer.sock";
 }
 
-void
-writeEXR(const char fileName[],
-    const float *pixels,
-    int width,
-    int height,
-    bool hasAlpha,
-    Compression compression = ZIP_COMPRESSION)
-{
-
-    Header header(width, height);
-    header.channels().insert("R", Channel(IMF::FLOAT));
-    header.channels().insert("G", Channel(IMF::FLOAT));
-    header.channels().insert("B", Channel(IMF::FLOAT));
-    if (hasAlpha) {
-        header.channels().insert("A", Channel(IMF::FLOAT));
-    }
-
-    const int stride = hasAlpha ? 4 : 3;
-
-    header.compression() = compression;
-
-    OutputFile file(fileName, header);
-
-    FrameBuffer frameBuffer;
-
-    frameBuffer.insert("R",                      // name
-        Slice(IMF::FLOAT,                        // type
-        (char *)pixels,                          // base
-        sizeof(*pixels) * stride,                // xStride
-        sizeof(*pixels) * stride * width));      // yStride
-
-    frameBuffer.insert("G",                      // name
-        Slice(IMF::FLOAT,                        // type
-        (char *)(pixels + 1),                    // base
-        sizeof(*pixels) * stride,                // xStride
-        sizeof(*pixels) * stride * width));      // yStride
-
-    frameBuffer.insert("B",                      // name
-        Slice(IMF::FLOAT,                        // type
-        (char *)(pixels + 2),                    // base
-        sizeof(*pixels) * stride,                // xStride
-        sizeof(*pixels) * stride * width));      // yStride
-
-    if (hasAlpha) {
-        frameBuffer.insert("A",                  // name
-            Slice(IMF::FLOAT,                    // type
-            (char *)(pixels + 3),                // base
-            sizeof(*pixels) * stride,            // xStride
-            sizeof(*pixels) * stride * width));  // yStride
+// Runs a persistent compose server, args are the arguments following --serve.
+int runServer(const vector<string>& args) {
+    if (args.empty()) {
+        cout << "missing socket path after --serve\n";
+        return 1;
     }
-
-    file.setFrameBuffer(frameBuffer);
-    file.writePixels(height);
-}
-
-// Returns true if result is RGBA, false if result is RGB.
-bool
-readEXR(const char fileName[],
-    Array2D<float> &pixels,
-    int &width, int &height,
-    bool readAlphaIfPresent)
-{
-    bool readAlpha = false;
-    try {
-        InputFile file(fileName);
-
-        Header header = file.header();
-        const Box2i dw = header.dataWindow();
-        width = dw.max.x - dw.min.x + 1;
-        height = dw.max.y - dw.min.y + 1;
-        const ChannelList channels = header.channels();
-        const bool hasAlpha = channels.findChannel("A") != nullptr;
-        readAlpha = hasAlpha && readAlphaIfPresent;
-
-        const int stride = readAlpha ? 4 : 3;
-
-        pixels.resizeErase(height, width * stride);
-
-        FrameBuffer frameBuffer;
-
-        frameBuffer.insert("R",                            // name
-            Slice(IMF::FLOAT,                              // type
-                (char *)(&pixels[0][0] -                   // base
-                dw.min.x * stride -
-                dw.min.y * stride * width),
-                sizeof(pixels[0][0]) * stride,             // xStride
-                sizeof(pixels[0][0]) * stride * width));   // yStride
-
-        frameBuffer.insert("G",                            // name
-            Slice(IMF::FLOAT,                              // type
-                (char *)(&pixels[0][1] -                   // base
-                dw.min.x * stride -
-                dw.min.y * stride * width),
-                sizeof(pixels[0][0]) * stride,              // xStride
-                sizeof(pixels[0][0]) * stride * width));    // yStride
-
-        frameBuffer.insert("B",                             // name
-            Slice(IMF::FLOAT,                               // type
-                (char *)(&pixels[0][2] -                    // base
-                dw.min.x * stride -
-                dw.min.y * stride * width),
-                sizeof(pixels[0][0]) * stride,              // xStride
-                sizeof(pixels[0][0]) * stride * width));    // yStride
-
-        if (readAlpha) {
-            frameBuffer.insert("A",                         // name
-                Slice(IMF::FLOAT,                           // type
-                    (char *)(&pixels[0][3] -                // base
-                    dw.min.x * stride -
-                    dw.min.y * stride * width),
-                    sizeof(pixels[0][0]) * stride,          // xStride
-                    sizeof(pixels[0][0]) * stride * width));// yStride
+    size_t frameCacheMegabytes = 4096;
+    int maxConcurrentJobs = 1;
+    for (vector<string>::const_iterator i = args.begin()+1; i != args.end(); ++i) {
+        if (*i == "--cache-size" && i + 1 != args.end()) {
+            frameCacheMegabytes = strtoul((++i)->c_str(), nullptr, 10);
+        } else if (*i == "--jobs" && i + 1 != args.end()) {
+            maxConcurrentJobs = atoi((++i)->c_str());
+        } else {
+            cout << "unknown argument " <<  *i << "\n";
+            displayHelp();
+            return 1;
         }
-
-        file.setFrameBuffer(frameBuffer);
-        file.readPixels(dw.min.y, dw.max.y);
-    }
-    catch (...)
-    {
-        cout << "Failed to read " << fileName << "\n";
-        throw;
     }
-    return readAlpha;
+    ComposeServer server(args[0], frameCacheMegabytes << 20, maxConcurrentJobs);
+    return server.run(cout);
 }
 
 int main( int argc, char *argv[], char *envp[] ) {
@@ -239,337 +120,43 @@ int main( int argc, char *argv[], char *envp[] ) {
     }
 
     vector<string> args(argv + 1, argv + argc);
-    string expression = args[0];
-
-    Compression compression = ZIP_COMPRESSION;
-    bool readAlpha = true;
-    bool verify = false;
+    if (args[0] == "--serve") {
+        return runServer(vector<string>(args.begin() + 1, args.end()));
+    }
 
-    // Loop over remaining command-line args
-    for (vector<string>::iterator i = args.begin()+1; i != args.end(); ++i) {
-        if (*i == "-h" || *i == "--help") {
-            displayHelp();
-            return 0;
-        } else if (*i == "-c" || *i == "--compression") {
-            string compressionString = toLower(*++i);
-            if (compressionString == "no") {
-                compression = NO_COMPRESSION;
-            } else if (compressionString == "rle") {
-                compression = RLE_COMPRESSION;
-            } else if (compressionString == "zip_single") {
-                compression = ZIPS_COMPRESSION;
-            } else if (compressionString == "zip") {
-                compression = ZIP_COMPRESSION;
-            } else if (compressionString == "piz") {
-                compression = PIZ_COMPRESSION;
-            } else if (compressionString == "pxr24") {
-                compression = PXR24_COMPRESSION;
-            } else if (compressionString == "b44") {
-                compression = B44_COMPRESSION;
-            } else if (compressionString == "b44a") {
-                compression = B44A_COMPRESSION;
-            } else if (compressionString == "dwaa") {
-                compression = DWAA_COMPRESSION;
-            } else if (compressionString == "dwab") {
-                compression = DWAB_COMPRESSION;
-            } else {
-                cout << "unknown compression method: " << *i << "\n";
-                displayHelp();
-                return 1;
-            }
-        } else if (*i == "-rgb" || *i == "--rgb") {
-            readAlpha = false;
-        } else if (*i == "-v" || *i == "--verify") {
-            verify = true;
+    // Jobs are either run in this process or forwarded to a running server.
+    string serverSocketPath;
+    vector<string> jobArgs;
+    for (vector<string>::iterator i = args.begin(); i != args.end(); ++i) {
+        if (i != args.begin() && *i == "--server" && i + 1 != args.end()) {
+            serverSocketPath = *++i;
         } else {
-            cout << "unknown argument " <<  *i << "\n";
-            displayHelp();
-            return 1;
+            jobArgs.push_back(*i);
         }
     }
 
-    Parser p(expression);
-    if(p.isValid()) {
-        cout << p.getRoot()->toString("") << "\n";
-        vector<string> inputFilePaths;
-        string outputFilePath;
-        std::function<void(const Parser::Node* node)> collectFunc;
-        collectFunc = [&](const Parser::Node* node) {
-            if (node->type == Parser::Node::INPUTFILEPATH) {
-                inputFilePaths.push_back(node->path);
-            }
-            else if (node->type == Parser::Node::OUTPUTFILEPATH) {
-                outputFilePath = node->path;
-            }
-            if (node->left)
-                node->left->evaluate(collectFunc);
-            if (node->right)
-                node->right->evaluate(collectFunc);
-        };
-        p.getRoot()->evaluate(collectFunc);
-        cout << "Collecting files...\n";
-        set<std::string> patches;
-        size_t numQuestionMarks = 0;
-        for (int i = 0; i < inputFilePaths.size(); i++) {
-            string pathString = inputFilePaths[i];
-            filesystem::path filePath(pathString);
-            filesystem::path folderPath = filePath.parent_path();
-            filesystem::path fileName = filePath.filename();
-            string fileNameString = fileName.string();
-            size_t numHashTags = std::count(fileNameString.begin(), fileNameString.end(), '#');
-            size_t countQuestionMarks = std::count(fileNameString.begin(), fileNameString.end(), '?');
-            if(numQuestionMarks != 0 && countQuestionMarks != 0 && numQuestionMarks != countQuestionMarks) {
-                cout << "error: different number of question marks in input files.\n";
-                cout << "use the same amount of question marks for each wildcard definition.\n";
-                return 1;
-            }
-            numQuestionMarks = countQuestionMarks;
-            if(numQuestionMarks != 0 && numHashTags != 0) {
-                cout << "error: cannot mix # and ? wildcards in same expression. use either one.\n";
-                return 1;
-            }
-            size_t numWildcards = numHashTags;
-            size_t searchStartPos = 0;
-            while(searchStartPos != string::npos && fileNameString.find('?', searchStartPos) != string::npos) {
-              numWildcards++;
-              searchStartPos = fileNameString.find('?', searchStartPos);
-              searchStartPos = fileNameString.find_first_not_of('?', searchStartPos);
-            }
-            if (numWildcards > 1) {
-                cout << "error: multiple wildcards in " << filePath.string() << "\n";
-                cout << "use only one wildcard per filename.\n";
-                return 1;
-            }
-            else if (numWildcards == 1) {
-                vector<string> nameSplit;
-                if(numQuestionMarks > 0) {
-                  nameSplit = split(toLower(fileNameString), string(numQuestionMarks, '?'));
-                } else {
-                  assert(numHashTags == 1);
-                  nameSplit = split(toLower(fileNameString), "#");
-                }
-                assert(nameSplit.size() == 2);
-                for (const auto & entry : filesystem::directory_iterator(folderPath)) {
-                    std::string otherFileName = toLower(entry.path().filename().string());
-                    size_t prefixPos = otherFileName.find(nameSplit[0]);
-                    size_t postfixPos = otherFileName.find(nameSplit[1]);
-                    if (prefixPos == 0 && postfixPos != string::npos) {
-                        string patch = otherFileName.substr(nameSplit[0].size(),
-                            otherFileName.size() - nameSplit[0].size() - nameSplit[1].size());
-                        if(numHashTags == 1 || (patch.length() == numQuestionMarks)) {
-                          patches.insert(patch);
-                        }
-                    }
-                }
-            }
-            else {
-                if (!filesystem::exists(filePath)) {
-                    cout << "error: " << filePath.string() << " does not exist.\n";
-                    return 1;
-                }
-            }
-        }
-        //  Check if all necessary input files exist and output error otherwise:
-        vector<string> missingFiles;
-        vector<string> outputFilePaths;
-        for (string patch : patches) {
-            // find missing files.
-            for (int i = 0; i < inputFilePaths.size(); i++) {
-                string pathString = inputFilePaths[i];
-                size_t wildCardLength = 1;
-                size_t wildCardPos = pathString.find("#");
-                if(wildCardPos == string::npos) {
-                  wildCardPos = pathString.find(string(numQuestionMarks, '?'));
-                  wildCardLength = numQuestionMarks;
-                }
-                assert(wildCardPos != string::npos);
-                pathString.replace(wildCardPos, wildCardLength, patch);
-                filesystem::path filePath(pathString);
-                if (!filesystem::exists(filePath)) {
-                    missingFiles.push_back(pathString);
-                }
-            }
-            // collect output file paths.
-            string pathString = outputFilePath;
-            size_t wildCardLength = 1;
-            size_t wildCardPos = pathString.find("#");
-            if(wildCardPos == string::npos) {
-                wildCardPos = pathString.find(string(numQuestionMarks, '?'));
-                wildCardLength = numQuestionMarks;
-            }
-            assert(wildCardPos != string::npos);
-            pathString.replace(wildCardPos, wildCardLength, patch);
-            filesystem::path filePath(pathString);
-            outputFilePaths.push_back(pathString);
-        }
-        if(patches.empty()) {
-            outputFilePaths.push_back(outputFilePath);
-        }
-        if (!missingFiles.empty()) {
-            cout << "error: Based on wildcards, the following files would be needed, but they don't exist:\n";
-            for (string path : missingFiles) {
-                cout << path << "\n";
-            }
-            return 1;
-        }
+    ComposeOptions options;
+    string errorMessage;
+    if (!parseComposeOptions(jobArgs, options, errorMessage)) {
+        cout << errorMessage << "\n";
+        displayHelp();
+        return 1;
+    }
+    if (options.showHelp) {
+        displayHelp();
+        return 0;
+    }
 
-        std::function<void(const Parser::Node*, const string& patch, CalcResult&)> evaluationFunc = [&](const Parser::Node* node, const string& patch, CalcResult& res) {
-            switch (node->type) {
-            case Parser::Node::INPUTFILEPATH: {
-                    int width, height;
-                    res.type = CalcResult::ARRAY;
-                    string fileName = node->path;
-                    size_t wildCardLength = 1;
-                    size_t wildCardPos = fileName.find("#");
-                    if(wildCardPos == string::npos) {
-                      wildCardPos = fileName.find(string(numQuestionMarks, '?'));
-                      wildCardLength = numQuestionMarks;
-                    }
-                    if(wildCardPos != string::npos)
-                        fileName.replace(wildCardPos, wildCardLength, patch);
-                    res.hasAlpha = readEXR(fileName.c_str(), res.array, width, height, readAlpha);
-                    return;
-                }
-                case Parser::Node::CONSTANT:
-                    res.type = CalcResult::CONSTANT;
-                    res.constant = node->constant;
-                    return;
-                case Parser::Node::ADD:
-                case Parser::Node::SUB:
-                case Parser::Node::MULT:
-                case Parser::Node::DIV:
-                {
-                    assert(node->left && node->right);
-                    CalcResult leftResult, rightResult;
-                    std::function<void(const Parser::Node*)> closed = [&](const Parser::Node* node) { evaluationFunc(node, patch, leftResult); };
-                    node->left->evaluate(closed);
-                    closed = [&](const Parser::Node* node) { evaluationFunc(node, patch, rightResult); };
-                    node->right->evaluate(closed);
-                    assert(leftResult.type != CalcResult::INVALID);
-                    assert(rightResult.type != CalcResult::INVALID);
-                    if (leftResult.type == CalcResult::CONSTANT && rightResult.type == CalcResult::CONSTANT) {
-                        res.type = CalcResult::CONSTANT;
-                        switch(node->type) {
-                            case Parser::Node::ADD:
-                                res.constant = leftResult.constant + rightResult.constant;
-                                break;
-                            case Parser::Node::SUB:
-                                res.constant = leftResult.constant - rightResult.constant;
-                                break;
-                            case Parser::Node::MULT:
-                                res.constant = leftResult.constant * rightResult.constant;
-                                break;
-                            case Parser::Node::DIV:
-                                res.constant = leftResult.constant / rightResult.constant;
-                                break;
-                            default:
-                                assert(false);
-                        }
-                    }
-                    else if (leftResult.type == CalcResult::ARRAY && rightResult.type == CalcResult::ARRAY) {
-                        if (leftResult.hasAlpha != rightResult.hasAlpha) {
-                            cout << "error: in " << node->toString(patch) << " \n";
-                            cout << "Alpha mismatch.\n";
-                            cout << "Some inputs have Alpha channels, others do not. Consider using -rgb argument to ignore alpha channels altogether.\n";
-                            assert(false);
-                        }
-                        if (leftResult.array.width() != rightResult.array.width() || leftResult.array.height() != rightResult.array.height()) {
-                            const int stride = leftResult.hasAlpha ? 4 : 3;
-                            cout << "error: in " << node->toString(patch) << " \n";
-                            cout << "resolution mismatch. Left is " << leftResult.array.width()/stride << "x" << leftResult.array.height()
-                                 << " and right is " << rightResult.array.width()/stride << "x" << rightResult.array.height() << "\n";
-                            assert(false);
-                        }
-                        res.type = CalcResult::ARRAY;
-                        res.array.resizeErase(leftResult.array.height(), leftResult.array.width());
-                        res.hasAlpha = leftResult.hasAlpha;
-                        CALCRESULT(leftResult.array[y][x], node->type, rightResult.array[y][x]);
-                    }
-                    else if (leftResult.type == CalcResult::ARRAY) {
-                        assert(rightResult.type == CalcResult::CONSTANT);
-                        // One Array operand and one constant operand.
-                        res.type = CalcResult::ARRAY;
-                        res.array.resizeErase(leftResult.array.height(), leftResult.array.width());
-                        res.hasAlpha = leftResult.hasAlpha;
-                        const float c = rightResult.constant;
-                        CALCRESULT(leftResult.array[y][x], node->type, c);
-                    }
-                    else if (rightResult.type == CalcResult::ARRAY) {
-                        assert(leftResult.type == CalcResult::CONSTANT);
-                        // One Array operand and one constant operand.
-                        res.type = CalcResult::ARRAY;
-                        res.array.resizeErase(rightResult.array.height(), rightResult.array.width());
-                        res.hasAlpha = rightResult.hasAlpha;
-                        const float c = leftResult.constant;
-                        CALCRESULT(c, node->type, rightResult.array[y][x]);
-                    }
-                    return;
-                }
-                default:
-                    assert(false);
-            }
-        };
-        const Parser::Node* root = p.getRoot();
-        if (patches.empty())
-            patches.insert("");
-        std::for_each(
-            std::execution::par_unseq,
-            patches.begin(),
-            patches.end(),
-            [&](const string& patch)
-            {
-                string targetFileName = root->left->path;
-                size_t wildCardLength = 1;
-                size_t wildCardPos = targetFileName.find("#");
-                if(wildCardPos == string::npos) {
-                    wildCardPos = targetFileName.find(string(numQuestionMarks, '?'));
-                    wildCardLength = numQuestionMarks;
-                }
-                if(wildCardPos != string::npos)
-                    targetFileName.replace(wildCardPos, wildCardLength, patch);
-                cout << "computing " << targetFileName << "               \r";
-                CalcResult res;
-                std::function<void(const Parser::Node*)> closed = [&](const Parser::Node* node) { evaluationFunc(node, patch, res); };
-                root->right->evaluate(closed);
-                assert(res.type == CalcResult::ARRAY);
-                const int stride = res.hasAlpha ? 4 : 3;
-                writeEXR(targetFileName.c_str(), res.array[0], res.array.width() / stride, res.array.height(), res.hasAlpha, compression);
-            });
-        if(verify) {
-            cout << "verifying written images...\n";
-            Array2D<float> pixels;
-            int width, height;
-            bool verificationSuccessful = true;
-            for(int i=0; i<outputFilePaths.size(); i++) {
-                string pathString = outputFilePaths[i];
-                cout << pathString << "                             \r";
-                filesystem::path filePath(pathString);
-                if (!filesystem::exists(filePath)) {
-                    cout << "error: " << filePath.string() << " has not been written.\n";
-                    verificationSuccessful = false;
-                }
-                else if(filesystem::file_size(pathString) == 0) {
-                    cout << "error: " << filePath.string() << " is 0 bytes.\n";
-                    verificationSuccessful = false;
-                } else
-                {
-                    try {
-                        readEXR(pathString.c_str(), pixels, width, height, true);
-                    }
-                    catch(...) {
-                        cout << "error: verification failed. " << filePath.string() << " could not be read.\n";
-                        verificationSuccessful = false;
-                    }
-                }
-            }
-            cout << "\n";
-            if(verificationSuccessful) {
-                cout << "verification succeeded, " <<  outputFilePaths.size() <<" files have been written.\n";
-            } else {
-                cout << "verification failed.\n";
-            }
-        }
-    } else {
-        cout << "error parsing expression: " << p.getErrorMessage() << "\n";
+    if (!serverSocketPath.empty()) {
+        return runComposeClient(serverSocketPath, jobArgs, cout);
+    }
+    // Keep progress out of the image data when writing to standard output.
+    Parser parser(options.expression);
+    bool outputIsStdout = false;
+    for (const Parser::Node* assignment : parser.getAssignments()) {
+        if (isPipePath(assignment->left->path) && pipeDescriptor(assignment->left->path, true) == 1)
+            outputIsStdout = true;
     }
-}
\ No newline at end of file
+    Composer composer;
+    return composer.compose(options, outputIsStdout ? cerr : cout);
+}
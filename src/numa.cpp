@@ -0,0 +1,167 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "stringutils.h"
+
+using namespace std;
+
+#ifdef _WIN32
+
+vector<NumaNode> numaNodes() {
+    vector<NumaNode> nodes;
+    ULONG highestNode = 0;
+    if (!GetNumaHighestNodeNumber(&highestNode))
+        return nodes;
+    // The processors the process may run on (e.g. restricted by a job
+    // object or start /affinity) are only known for its primary group.
+    DWORD_PTR processMask = 0, systemMask = 0;
+    GROUP_AFFINITY threadAffinity = {};
+    const bool hasProcessMask = GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) && processMask != 0 &&
+                                GetThreadGroupAffinity(GetCurrentThread(), &threadAffinity);
+    for (ULONG n = 0; n <= highestNode; n++) {
+        GROUP_AFFINITY affinity = {};
+        if (!GetNumaNodeProcessorMaskEx(USHORT(n), &affinity))
+            continue;
+        if (hasProcessMask && affinity.Group == threadAffinity.Group)
+            affinity.Mask &= processMask;
+        if (affinity.Mask == 0)
+            continue;
+        NumaNode node;
+        node.index = int(n);
+        node.group = affinity.Group;
+        for (int i = 0; i < int(sizeof(KAFFINITY) * 8); i++) {
+            if (affinity.Mask & (KAFFINITY(1) << i))
+                node.processors.push_back(i);
+        }
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+bool pinCurrentThread(const NumaNode& node) {
+    GROUP_AFFINITY affinity = {};
+    affinity.Group = node.group;
+    for (int processor : node.processors)
+        affinity.Mask |= KAFFINITY(1) << processor;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+}
+
+#else
+
+namespace {
+
+// Parses a kernel cpu list such as "0-15,32-47".
+vector<int> parseCpuList(const string& cpuList) {
+    vector<int> cpus;
+    for (const string& range : split(trim(cpuList), ",")) {
+        if (range.empty())
+            continue;
+        const size_t dashPos = range.find('-');
+        const int first = atoi(range.substr(0, dashPos).c_str());
+        const int last = dashPos == string::npos ? first : atoi(range.substr(dashPos + 1).c_str());
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+}  // namespace
+
+vector<NumaNode> numaNodes() {
+    vector<NumaNode> nodes;
+    // The processors the process may run on, e.g. restricted by taskset or
+    // cgroups.
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool hasAllowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    error_code ec;
+    for (filesystem::directory_iterator it("/sys/devices/system/node", ec), end; !ec && it != end; it.increment(ec)) {
+        const string name = it->path().filename().string();
+        if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+            !all_of(name.begin() + 4, name.end(), [](char c) { return isdigit((unsigned char)c); })) {
+            continue;
+        }
+        ifstream cpuListFile(it->path() / "cpulist");
+        string cpuList;
+        getline(cpuListFile, cpuList);
+        NumaNode node;
+        node.index = atoi(name.c_str() + 4);
+        for (int cpu : parseCpuList(cpuList)) {
+            if (!hasAllowed || (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                node.processors.push_back(cpu);
+        }
+        if (!node.processors.empty())
+            nodes.push_back(node);
+    }
+    sort(nodes.begin(), nodes.end(), [](const NumaNode& a, const NumaNode& b) { return a.index < b.index; });
+    return nodes;
+}
+
+bool pinCurrentThread(const NumaNode& node) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (int processor : node.processors) {
+        if (processor >= 0 && processor < CPU_SETSIZE)
+            CPU_SET(processor, &cpus);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+#endif
+
+size_t forEachOnNumaNodes(const vector<NumaNode>& nodes,
+                          size_t count,
+                          const function<void(size_t)>& work) {
+    if (nodes.empty()) {
+        for (size_t i = 0; i < count; i++)
+            work(i);
+        return 0;
+    }
+    // Node n owns the items n, n + nodes.size(), n + 2 * nodes.size(), ...
+    // next[n] counts the items of node n that have been handed out.
+    vector<atomic<size_t>> next(nodes.size());
+    for (atomic<size_t>& n : next)
+        n = 0;
+    auto takeItem = [&](size_t node, size_t& item) {
+        const size_t position = next[node]++;
+        item = node + position * nodes.size();
+        return item < count;
+    };
+
+    atomic<size_t> numUnpinned = 0;
+    vector<thread> workers;
+    for (size_t n = 0; n < nodes.size(); n++) {
+        for (size_t p = 0; p < nodes[n].processors.size(); p++) {
+            workers.emplace_back([&, n]() {
+                if (!pinCurrentThread(nodes[n]))
+                    numUnpinned++;
+                size_t item;
+                while (takeItem(n, item))
+                    work(item);
+                for (size_t other = 1; other < nodes.size(); other++) {
+                    while (takeItem((n + other) % nodes.size(), item))
+                        work(item);
+                }
+            });
+        }
+    }
+    for (thread& worker : workers)
+        worker.join();
+    return numUnpinned;
+}
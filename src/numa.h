@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// A NUMA node and the logical processors belonging to it.
+struct NumaNode {
+    int index = 0;
+    // Processor group of the node. Always 0 outside of Windows.
+    unsigned short group = 0;
+    // Processor numbers, relative to the group on Windows.
+    std::vector<int> processors;
+};
+
+// Returns the NUMA nodes of the machine with the processors of each the
+// process is allowed to run on. Nodes without such processors are left
+// out. Returns a single node or none if the machine is not NUMA or the
+// topology cannot be determined.
+std::vector<NumaNode> numaNodes();
+
+// Restricts the calling thread to the processors of node. Returns false if
+// that is not possible.
+bool pinCurrentThread(const NumaNode& node);
+
+// Calls work(i) for every i in [0, count) on worker threads pinned to
+// nodes, one thread per processor. Items are assigned to the nodes round
+// robin and every item is processed entirely by one thread, so all memory
+// it allocates is first touched, and therefore placed, on that thread's
+// node. Nodes that run out of items take over the remaining items of other
+// nodes. work must not throw. Returns the number of worker threads that
+// could not be pinned and ran on any processor instead.
+size_t forEachOnNumaNodes(const std::vector<NumaNode>& nodes,
+                          size_t count,
+                          const std::function<void(size_t)>& work);
@@ -0,0 +1,196 @@
+#include "options.h"
+
+#include <cstdlib>
+
+#include "stringutils.h"
+
+using namespace std;
+using namespace OPENEXR_IMF_NAMESPACE;
+
+string compressionName(Compression compression) {
+    switch (compression) {
+        case NO_COMPRESSION:
+            return "NO";
+        case RLE_COMPRESSION:
+            return "RLE";
+        case ZIPS_COMPRESSION:
+            return "ZIP_SINGLE";
+        case ZIP_COMPRESSION:
+            return "ZIP";
+        case PIZ_COMPRESSION:
+            return "PIZ";
+        case PXR24_COMPRESSION:
+            return "PXR24";
+        case B44_COMPRESSION:
+            return "B44";
+        case B44A_COMPRESSION:
+            return "B44A";
+        case DWAA_COMPRESSION:
+            return "DWAA";
+        case DWAB_COMPRESSION:
+            return "DWAB";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+bool parseComposeOptions(const vector<string>& args,
+                         ComposeOptions& options,
+                         string& errorMessage) {
+    if (args.empty()) {
+        errorMessage = "missing expression";
+        return false;
+    }
+    options.expression = args[0];
+
+    // Loop over remaining args
+    for (vector<string>::const_iterator i = args.begin()+1; i != args.end(); ++i) {
+        if (*i == "-h" || *i == "--help") {
+            options.showHelp = true;
+        } else if (*i == "-c" || *i == "--compression") {
+            if (i + 1 == args.end()) {
+                errorMessage = "missing compression method after " + *i;
+                return false;
+            }
+            string compressionString = toLower(*++i);
+            options.autoCompression = ComposeOptions::AUTO_OFF;
+            if (compressionString == "auto" || compressionString == "auto:balanced") {
+                options.autoCompression = ComposeOptions::AUTO_BALANCED;
+            } else if (compressionString == "auto:size") {
+                options.autoCompression = ComposeOptions::AUTO_SIZE;
+            } else if (compressionString == "auto:speed") {
+                options.autoCompression = ComposeOptions::AUTO_SPEED;
+            } else if (compressionString == "no") {
+                options.compression = NO_COMPRESSION;
+            } else if (compressionString == "rle") {
+                options.compression = RLE_COMPRESSION;
+            } else if (compressionString == "zip_single") {
+                options.compression = ZIPS_COMPRESSION;
+            } else if (compressionString == "zip") {
+                options.compression = ZIP_COMPRESSION;
+            } else if (compressionString == "piz") {
+                options.compression = PIZ_COMPRESSION;
+            } else if (compressionString == "pxr24") {
+                options.compression = PXR24_COMPRESSION;
+            } else if (compressionString == "b44") {
+                options.compression = B44_COMPRESSION;
+            } else if (compressionString == "b44a") {
+                options.compression = B44A_COMPRESSION;
+            } else if (compressionString == "dwaa") {
+                options.compression = DWAA_COMPRESSION;
+            } else if (compressionString == "dwab") {
+                options.compression = DWAB_COMPRESSION;
+            } else {
+                errorMessage = "unknown compression method: " + *i;
+                return false;
+            }
+        } else if (*i == "-rgb" || *i == "--rgb") {
+            options.readAlpha = false;
+        } else if (*i == "-v" || *i == "--verify") {
+            options.verify = true;
+        } else if (*i == "--frames") {
+            if (i + 1 == args.end()) {
+                errorMessage = "missing frame range after " + *i;
+                return false;
+            }
+            string range = *++i;
+            size_t dashPos = range.find('-', 1);
+            string first = range.substr(0, dashPos);
+            string last = dashPos == string::npos ? first : range.substr(dashPos + 1);
+            char* firstEnd = nullptr;
+            char* lastEnd = nullptr;
+            options.firstFrame = strtoll(first.c_str(), &firstEnd, 10);
+            options.lastFrame = strtoll(last.c_str(), &lastEnd, 10);
+            if (first.empty() || last.empty() || *firstEnd != '\0' || *lastEnd != '\0' ||
+                options.firstFrame > options.lastFrame) {
+                errorMessage = "invalid frame range: " + range + " (expected first-last)";
+                return false;
+            }
+            options.hasFrameRange = true;
+        } else if (*i == "--shard") {
+            if (i + 1 == args.end()) {
+                errorMessage = "missing shard after " + *i;
+                return false;
+            }
+            string shard = *++i;
+            vector<string> shardSplit = split(shard, "/");
+            char* indexEnd = nullptr;
+            char* countEnd = nullptr;
+            if (shardSplit.size() == 2) {
+                options.shardIndex = int(strtol(shardSplit[0].c_str(), &indexEnd, 10));
+                options.shardCount = int(strtol(shardSplit[1].c_str(), &countEnd, 10));
+            }
+            if (shardSplit.size() != 2 || shardSplit[0].empty() || shardSplit[1].empty() ||
+                *indexEnd != '\0' || *countEnd != '\0' ||
+                options.shardCount < 1 || options.shardIndex < 0 || options.shardIndex >= options.shardCount) {
+                errorMessage = "invalid shard: " + shard + " (expected i/N with 0 <= i < N)";
+                return false;
+            }
+        } else if (*i == "--shard-by") {
+            if (i + 1 == args.end()) {
+                errorMessage = "missing balancing method after " + *i;
+                return false;
+            }
+            string shardBy = toLower(*++i);
+            if (shardBy == "frames") {
+                options.shardByBytes = false;
+            } else if (shardBy == "bytes") {
+                options.shardByBytes = true;
+            } else {
+                errorMessage = "unknown balancing method: " + *i + " (expected frames or bytes)";
+                return false;
+            }
+        } else if (*i == "--proxy") {
+            if (i + 1 == args.end()) {
+                errorMessage = "missing proxy factor after " + *i;
+                return false;
+            }
+            string factor = *++i;
+            char* factorEnd = nullptr;
+            options.proxyFactor = int(strtol(factor.c_str(), &factorEnd, 10));
+            if (factor.empty() || *factorEnd != '\0' || options.proxyFactor < 1) {
+                errorMessage = "invalid proxy factor: " + factor + " (expected a positive integer)";
+                return false;
+            }
+        } else if (*i == "--roi") {
+            if (i + 1 == args.end()) {
+                errorMessage = "missing region after " + *i;
+                return false;
+            }
+            string region = *++i;
+            vector<string> coordinates = split(region, ",");
+            vector<long> values;
+            for (const string& coordinate : coordinates) {
+                char* coordinateEnd = nullptr;
+                values.push_back(strtol(coordinate.c_str(), &coordinateEnd, 10));
+                if (coordinate.empty() || *coordinateEnd != '\0')
+                    values.clear();
+            }
+            if (coordinates.size() != 4 || values.size() != 4 || values[0] > values[2] || values[1] > values[3]) {
+                errorMessage = "invalid region: " + region + " (expected x0,y0,x1,y1 with x0 <= x1 and y0 <= y1)";
+                return false;
+            }
+            options.hasRegion = true;
+            options.regionMinX = int(values[0]);
+            options.regionMinY = int(values[1]);
+            options.regionMaxX = int(values[2]);
+            options.regionMaxY = int(values[3]);
+        } else if (*i == "--roi-patch") {
+            options.patchRegion = true;
+        } else if (*i == "--numa") {
+            options.numa = true;
+        } else {
+            errorMessage = "unknown argument " + *i;
+            return false;
+        }
+    }
+    if (options.patchRegion && !options.hasRegion) {
+        errorMessage = "--roi-patch requires --roi";
+        return false;
+    }
+    if (options.hasRegion && options.proxyFactor > 1) {
+        errorMessage = "--roi cannot be combined with --proxy";
+        return false;
+    }
+    return true;
+}
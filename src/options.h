@@ -0,0 +1,60 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <OpenEXR/IlmImf/ImfCompression.h>
+#include <OpenEXR/IlmImf/ImfNamespace.h>
+
+// Settings of a single compose job.
+struct ComposeOptions {
+    // Targets for picking the compression by benchmarking the first frame.
+    enum AutoCompression { AUTO_OFF, AUTO_SIZE, AUTO_SPEED, AUTO_BALANCED };
+
+    std::string expression;
+    OPENEXR_IMF_NAMESPACE::Compression compression = OPENEXR_IMF_NAMESPACE::ZIP_COMPRESSION;
+    AutoCompression autoCompression = AUTO_OFF;
+    bool readAlpha = true;
+    bool verify = false;
+    bool showHelp = false;
+    // Only frames within [firstFrame, lastFrame] are processed if hasFrameRange.
+    bool hasFrameRange = false;
+    long long firstFrame = 0;
+    long long lastFrame = 0;
+    // The frames are split into shardCount parts of which only the part with
+    // index shardIndex (0 based) is processed.
+    int shardIndex = 0;
+    int shardCount = 1;
+    // Balance shards by input bytes per frame instead of number of frames.
+    bool shardByBytes = false;
+    // Inputs are read at 1/proxyFactor of their resolution for previews.
+    int proxyFactor = 1;
+    // Only the region [regionMinX, regionMaxX] x [regionMinY, regionMaxY]
+    // (inclusive pixel coordinates) is evaluated if hasRegion. It is written
+    // as a cropped output, or into the existing output if patchRegion.
+    bool hasRegion = false;
+    int regionMinX = 0;
+    int regionMinY = 0;
+    int regionMaxX = 0;
+    int regionMaxY = 0;
+    bool patchRegion = false;
+    // Pin the frame workers to the NUMA nodes of the machine, computing each
+    // frame entirely on one node.
+    bool numa = false;
+    // Whether inputs and outputs may be pipes (see pipes.h).
+    bool allowPipes = true;
+    // Relative input and output paths are resolved against this directory.
+    // If empty, the current working directory of the process is used.
+    std::filesystem::path workingDirectory;
+};
+
+// Returns the command-line name of a compression, e.g. "ZIP".
+std::string compressionName(OPENEXR_IMF_NAMESPACE::Compression compression);
+
+// Parses the expression followed by the job arguments (as given on the
+// command line) into options. Returns false and sets errorMessage if an
+// argument is invalid.
+bool parseComposeOptions(const std::vector<std::string>& args,
+                         ComposeOptions& options,
+                         std::string& errorMessage);
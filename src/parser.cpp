@@ -1,16 +1,72 @@
 #include "parser.h"
 
 #include <algorithm>
-#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
 
 #include "stringutils.h"
 
 using namespace std;
 
+namespace {
+
+// Built-in pixel functions.
+struct Function {
+    const char* name;
+    Parser::Node::NodeType type;
+    size_t numArguments;
+};
+
+const Function kFunctions[] = {
+    {"min", Parser::Node::MIN, 2},
+    {"max", Parser::Node::MAX, 2},
+    {"clamp", Parser::Node::CLAMP, 3},
+    {"pow", Parser::Node::POW, 2},
+    {"lerp", Parser::Node::LERP, 3},
+    {"over", Parser::Node::OVER, 2},
+};
+
+const Function* findFunction(Parser::Node::NodeType type) {
+    for (const Function& function : kFunctions) {
+        if (function.type == type)
+            return &function;
+    }
+    return nullptr;
+}
+
+const Function* findFunction(const string& name) {
+    for (const Function& function : kFunctions) {
+        if (name == function.name)
+            return &function;
+    }
+    return nullptr;
+}
+
+bool isChannel(char c) {
+    return c == 'R' || c == 'G' || c == 'B' || c == 'A';
+}
+
+}  // namespace
+
 string Parser::Node::toString(const string& patch) const {
+    string res;
+    appendTo(res, patch);
+    return res;
+}
+
+// Appends to a single string, so printing deep trees stays linear.
+void Parser::Node::appendTo(string& s, const string& patch) const {
+    auto appendChild = [&](const Node* child) {
+        if (child)
+            child->appendTo(s, patch);
+        else
+            s += "null";
+    };
     switch(type) {
         case Node::INVALID:
-            return "INVALID";
+            s += "INVALID";
+            return;
         case Node::INPUTFILEPATH:
         case Node::OUTPUTFILEPATH:
             if(!patch.empty()) {
@@ -24,29 +80,50 @@ string Parser::Node::toString(const string& patch) const {
                 if(wildCardPos != string::npos) {
                     res.replace(wildCardPos, wildCardLength, patch);
                 }
-                return res;
+                s += res;
             } else {
-                return path;
+                s += path;
             }
+            if (!part.empty())
+                s += "[" + part + "]";
+            if (!channel.empty())
+                s += "." + channel;
+            return;
         case Node::CONSTANT:
-            return to_string(constant);
+            s += to_string(constant);
+            return;
         case Node::ADD:
-            return string("(") + (left?left->toString(patch):"null") + " + " +
-                                 (right?right->toString(patch):"null") + ")";
         case Node::SUB:
-            return string("(") + (left?left->toString(patch):"null") + " - " +
-                                 (right?right->toString(patch):"null") + ")";
         case Node::MULT:
-            return string("(") + (left?left->toString(patch):"null") + " * " +
-                                 (right?right->toString(patch):"null") + ")";
         case Node::DIV:
-            return string("(") + (left?left->toString(patch):"null") + " / " +
-                                 (right?right->toString(patch):"null") + ")";
+            s += "(";
+            appendChild(left);
+            s += type == Node::ADD ? " + " : type == Node::SUB ? " - " : type == Node::MULT ? " * " : " / ";
+            appendChild(right);
+            s += ")";
+            return;
         case Node::ASSIGN:
-            return (left?left->toString(patch):"null") + " = " +
-                   (right?right->toString(patch):"null");
+            appendChild(left);
+            s += " = ";
+            appendChild(right);
+            return;
+        case Node::MIN:
+        case Node::MAX:
+        case Node::CLAMP:
+        case Node::POW:
+        case Node::LERP:
+        case Node::OVER:
+            s += findFunction(type)->name;
+            s += "(";
+            for (size_t i = 0; i < arguments.size(); i++) {
+                if (i > 0)
+                    s += ", ";
+                appendChild(arguments[i]);
+            }
+            s += ")";
+            return;
         default:
-            return string("NOT IMPLEMENTED:") + to_string(type) + "this:" + to_string(size_t(this));
+            s += string("NOT IMPLEMENTED:") + to_string(type) + "this:" + to_string(size_t(this));
     }
 }
 
@@ -54,196 +131,342 @@ void Parser::Node::evaluate(std::function<void(const Parser::Node* node)>& lambd
     return lambda(this);
 }
 
-Parser::Token::Token(char operation) : s(string(1, operation)) {
-    switch(operation) {
+bool Parser::Node::isConstant(float& value) const {
+    float leftValue, rightValue;
+    switch(type) {
+        case Node::CONSTANT:
+            value = constant;
+            return true;
+        case Node::ADD:
+        case Node::SUB:
+        case Node::MULT:
+        case Node::DIV:
+            if (!left || !right || !left->isConstant(leftValue) || !right->isConstant(rightValue))
+                return false;
+            if (type == Node::ADD)
+                value = leftValue + rightValue;
+            else if (type == Node::SUB)
+                value = leftValue - rightValue;
+            else if (type == Node::MULT)
+                value = leftValue * rightValue;
+            else
+                value = leftValue / rightValue;
+            return true;
+        case Node::MIN:
+        case Node::MAX:
+        case Node::CLAMP:
+        case Node::POW:
+        case Node::LERP: {
+            float values[3];
+            if (arguments.size() != findFunction(type)->numArguments)
+                return false;
+            for (size_t i = 0; i < arguments.size(); i++) {
+                if (!arguments[i]->isConstant(values[i]))
+                    return false;
+            }
+            if (type == Node::MIN)
+                value = std::min(values[0], values[1]);
+            else if (type == Node::MAX)
+                value = std::max(values[0], values[1]);
+            else if (type == Node::CLAMP)
+                value = std::min(std::max(values[0], values[1]), values[2]);
+            else if (type == Node::POW)
+                value = std::pow(values[0], values[1]);
+            else
+                value = values[0] + (values[1] - values[0]) * values[2];
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+namespace {
+
+// Binding strength of a binary operator, 0 if c is no operator.
+int precedence(char c) {
+    switch(c) {
         case '+':
-            type = ADD;
-            break;
         case '-':
-            type = SUB;
-            break;
+            return 1;
         case '*':
-            type = MULT;
-            break;
         case '/':
-            type = DIV;
-            break;
+            return 2;
         default:
-            assert(false);
+            return 0;
     }
-};
+}
 
-Parser::Node::NodeType nodeTypeFromTokenType(Parser::Token::TokenType t) {
-    switch(t) {
-        case Parser::Token::FILEPATH:
-            return Parser::Node::INPUTFILEPATH;
-        case Parser::Token::CONSTANT:
-            return Parser::Node::CONSTANT;
-        case Parser::Token::ADD:
+Parser::Node::NodeType nodeTypeFromOperator(char c) {
+    switch(c) {
+        case '+':
             return Parser::Node::ADD;
-        case Parser::Token::SUB:
+        case '-':
             return Parser::Node::SUB;
-        case Parser::Token::MULT:
+        case '*':
             return Parser::Node::MULT;
-        case Parser::Token::DIV:
+        case '/':
             return Parser::Node::DIV;
-        case Parser::Token::SUBTERM:
         default:
             return Parser::Node::INVALID;
     }
 }
 
-// If the string starts with '(' and ends with ')', removes these characters.
-string unwrap(const string &s) {
-    string tmp = trim(s);
-    while (tmp.front() == '(' && tmp.back() == ')') {
-        tmp = tmp.substr(1, tmp.size()-2);
-        tmp = trim(tmp);
-    }
-    return tmp;
-}
-
-// Parses string into an array off top-level Token.
-vector<Parser::Token> Parser::serializeOperandsAndParentheses(string s) {
-    s = unwrap(s);
-    size_t currentPos = 0;
-    vector<Token> result;
-    while(currentPos < s.size()) {
-        // skip whitespace
-        currentPos = s.find_first_not_of(" ", currentPos);
-        assert(currentPos != string::npos);
-        size_t currentTokenEndPos = s.find_first_of("()+-*/", currentPos);
-        if(currentPos == currentTokenEndPos) {
-            char sign = s[currentPos];
-            assert(sign != ')');
-            // TODO handle malformed input
-            if(s.find_first_of("+-*/", currentPos) == currentPos) {
-                result.push_back(Token(sign));
-                currentPos++;
-            } else {
-                assert(sign == '(');
-                // Find matching closing parenthesis.
-                int parenthesesOpened = 1;
-                size_t idx = currentPos;
-                while(parenthesesOpened!=0 && idx < s.size()-1) {
-                    idx++;
-                    char charAtIdx = s[idx];
-                    if(charAtIdx == '(')
-                        parenthesesOpened++;
-                    else if(charAtIdx == ')')
-                        parenthesesOpened--;
-                }
-                // TODO: Handle mismatching parentheses.
-                assert(idx < s.size());
-                assert(idx > currentPos);
-                size_t termLength = idx+1-currentPos;
-                result.push_back(Token(Token::SUBTERM, s.substr(currentPos, termLength)));
-                currentPos += termLength;
-            }
-        } else {
-            //parsing a path or constant.
-            //check if string is a constant first.
-            char* end = nullptr;
-            const char* cs = s.c_str();
-            const char* currentPosPtr = cs + currentPos;
-            float converted = strtof(currentPosPtr, &end);
-            if (converted != 0.0) {
-                // Parsing a constan.
-                // TODO: handle constants that are 0.
-                assert(end > currentPosPtr);
-                size_t charsParsed = end - currentPosPtr;
-                string constantString = s.substr(currentPos, charsParsed);
-                result.push_back(Token(Token::CONSTANT, constantString));
-                currentPos += charsParsed;
-            } else {
-                // Parsing a path.
-                std::string lower = toLower(s);
-                size_t extensionPos = lower.find(".exr", currentPos);
-                //TODO: handle invalid input here.
-                assert(extensionPos != string::npos);
-                assert(extensionPos > currentPos);
-                size_t pathLength = extensionPos - currentPos + 4;
-                string path = s.substr(currentPos, pathLength);
-                result.push_back(Token(Token::FILEPATH, path));
-                currentPos += pathLength;
-            }
-        }
+}  // namespace
+
+Parser::Node* Parser::newNode(Node::NodeType type) {
+    _nodes.emplace_back();
+    Node* node = &_nodes.back();
+    node->type = type;
+    return node;
+}
+
+Parser::Node* Parser::fail(const string& message) {
+    if (_errorMessage.empty()) {
+        _errorMessage = message + " at position " + to_string(_pos + 1) + ":\n" +
+                        _expression + "\n" + string(_pos, ' ') + "^";
     }
-    return result;
+    return nullptr;
 }
 
-Parser::Node* Parser::parse(string s) {
-    vector<Token> serialized = serializeOperandsAndParentheses(s);
-    return parse(serialized);
+void Parser::skipWhitespace() {
+    while (_pos < _input.size() && isspace((unsigned char)_input[_pos]))
+        _pos++;
 }
 
-Parser::Node* Parser::parse(vector<Parser::Token> serialized) {
-    if(serialized.empty()) {
-        // some error happened.
-        return nullptr;
+bool Parser::isPathEnd(size_t pos) const {
+    auto isBoundary = [&](size_t end) {
+        return end == _input.size() || isspace((unsigned char)_input[end]) ||
+               precedence(_input[end]) != 0 || _input[end] == ')' ||
+               _input[end] == ';' || _input[end] == ',' || _input[end] == '[';
+    };
+    if (isBoundary(pos))
+        return true;
+    // A channel selection such as ".A" may follow the path.
+    return _input[pos] == '.' && pos + 1 < _input.size() && isChannel(_input[pos + 1]) && isBoundary(pos + 2);
+}
+
+size_t Parser::scanPath() const {
+    // Pipes are given as "pipe:" or "pipe:N" with a file descriptor N.
+    if (_input.substr(_pos, 5) == "pipe:") {
+        size_t end = _pos + 5;
+        while (end < _input.size() && isdigit((unsigned char)_input[end]))
+            end++;
+        if (isPathEnd(end))
+            return end - _pos;
     }
-    assert(serialized.size() % 2 == 1);
-    if(serialized.size() == 1) {
-        Node* result = new Node();
-        switch(serialized[0].type) {
-            case Token::FILEPATH:
-                result->type = Node::INPUTFILEPATH;
-                result->path = serialized[0].s;
-                break;
-            case Token::CONSTANT:
-                result->type = Node::CONSTANT;
-                result->constant = strtof(serialized[0].s.c_str(), nullptr);
-                break;
-            case Token::SUBTERM:
-                return parse(serialized[0].s);
-            default:
-                assert(false);
+    // A path extends up to the first ".exr" (in any case) that is followed
+    // by the end of the expression, whitespace, an operator, ')', ';', ',',
+    // a part name or a channel selection.
+    for (size_t i = _pos; i + 4 <= _input.size(); i++) {
+        if (_input[i] != '.' ||
+            tolower((unsigned char)_input[i + 1]) != 'e' ||
+            tolower((unsigned char)_input[i + 2]) != 'x' ||
+            tolower((unsigned char)_input[i + 3]) != 'r') {
+            continue;
         }
-        return result;
-    }
-    // find weakest operator, this is the root.
-    int weakest = 1;
-    bool weakestIsAddOrSub = serialized[weakest].isAddOrSub();
-    for (int i=3; i<serialized.size(); i+=2) {
-        const Token& t = serialized[i];
-        assert(t.isOperator());
-        if (t.isAddOrSub()) {
-            weakest = i;
-            weakestIsAddOrSub = true;
-        } else if(!weakestIsAddOrSub) {
-            weakest = i;
+        if (isPathEnd(i + 4))
+            return i + 4 - _pos;
+    }
+    return 0;
+}
+
+Parser::Node* Parser::parseOperand() {
+    skipWhitespace();
+    if (_pos == _input.size())
+        return fail("expected a file path, constant or '('");
+    const char c = _input[_pos];
+    if (c == '(') {
+        _pos++;
+        Node* node = parseExpression(1);
+        if (!node)
+            return nullptr;
+        skipWhitespace();
+        if (_pos == _input.size() || _input[_pos] != ')')
+            return fail("expected ')'");
+        _pos++;
+        return node;
+    }
+    if (c == ')' || c == ',')
+        return fail(string("unexpected '") + c + "'");
+    if (precedence(c) != 0 && c != '-' && c != '+')
+        return fail(string("unexpected '") + c + "'");
+
+    // Function calls, e.g. "max(a.exr, 0)". Other names followed by '(' are
+    // left to be read as file paths.
+    if (isalpha((unsigned char)c)) {
+        size_t end = _pos;
+        while (end < _input.size() && isalpha((unsigned char)_input[end]))
+            end++;
+        const Function* function = findFunction(toLower(string(_input.substr(_pos, end - _pos))));
+        while (end < _input.size() && isspace((unsigned char)_input[end]))
+            end++;
+        if (function && end < _input.size() && _input[end] == '(') {
+            _pos = end;
+            return parseFunction(function->type, function->name);
+        }
+    }
+
+    // Try a constant first. It only counts as one if it is not the start of
+    // a file name such as "0001.exr".
+    const char* begin = _input.data() + _pos;
+    char* end = nullptr;
+    const float value = strtof(begin, &end);
+    if (end > begin) {
+        size_t next = _pos + (end - begin);
+        while (next < _input.size() && isspace((unsigned char)_input[next]))
+            next++;
+        if (next == _input.size() || precedence(_input[next]) != 0 ||
+            _input[next] == ')' || _input[next] == ';' || _input[next] == ',') {
+            Node* node = newNode(Node::CONSTANT);
+            node->constant = value;
+            _pos += end - begin;
+            return node;
         }
     }
-    assert(weakest < serialized.size() - 1);
-    Node* result = new Node();
-    result->type = nodeTypeFromTokenType(serialized[weakest].type);
-    result->left = parse(vector<Token>(serialized.begin(), serialized.begin() + weakest));
-    result->right = parse(vector<Token>(serialized.begin() + weakest + 1, serialized.end()));
-    return result;
+
+    if (c == '-' || c == '+')
+        return fail(string("unexpected '") + c + "'");
+    const size_t pathLength = scanPath();
+    if (pathLength == 0)
+        return fail("expected a file path ending in .exr, a pipe or a constant");
+    Node* node = newNode(Node::INPUTFILEPATH);
+    node->path = string(_input.substr(_pos, pathLength));
+    _pos += pathLength;
+    if (!parsePart(node))
+        return nullptr;
+    if (_pos + 1 < _input.size() && _input[_pos] == '.' && isChannel(_input[_pos + 1])) {
+        node->channel = string(1, _input[_pos + 1]);
+        _pos += 2;
+    }
+    return node;
 }
 
-Parser::Parser(string exp)
-    :_isValid(false) {
-    // parse root
-    string s = exp;
-    if(std::count(s.begin(), s.end(), '=') != 1) {
-        _errorMessage = "Expression must contain exactly one occurance of '='.";
-        return;
+Parser::Node* Parser::parseFunction(Node::NodeType type, const string& name) {
+    // Skip the '('.
+    _pos++;
+    Node* node = newNode(type);
+    while (true) {
+        Node* argument = parseExpression(1);
+        if (!argument)
+            return nullptr;
+        node->arguments.push_back(argument);
+        skipWhitespace();
+        if (_pos < _input.size() && _input[_pos] == ',') {
+            _pos++;
+            continue;
+        }
+        if (_pos < _input.size() && _input[_pos] == ')')
+            break;
+        return fail("expected ',' or ')'");
+    }
+    const size_t numArguments = findFunction(type)->numArguments;
+    if (node->arguments.size() != numArguments) {
+        return fail(name + " expects " + to_string(numArguments) + " arguments, got " +
+                    to_string(node->arguments.size()));
     }
+    _pos++;
+    return node;
+}
 
-    _root.type = Node::ASSIGN;
-    vector<string> rootExpressions = split(s, "=");
-    assert(rootExpressions.size() == 2);
-    _root.left = new Node();
-    _root.left->type = Node::OUTPUTFILEPATH;
-    _root.left->path = rootExpressions[0];
+bool Parser::parsePart(Node* node) {
+    if (_pos == _input.size() || _input[_pos] != '[')
+        return true;
+    const size_t end = _input.find(']', _pos);
+    if (end == string_view::npos) {
+        fail("expected ']'");
+        return false;
+    }
+    node->part = trim(string(_input.substr(_pos + 1, end - _pos - 1)));
+    if (node->part.empty()) {
+        _pos++;
+        fail("expected a part name");
+        return false;
+    }
+    _pos = end + 1;
+    return true;
+}
 
-    Node* right = parse(rootExpressions[1]);
-    if(!right) {
-        // parsing failed. _errorMessage already contains reason.
-        return;
+Parser::Node* Parser::parseExpression(int minPrecedence) {
+    Node* left = parseOperand();
+    if (!left)
+        return nullptr;
+    while (true) {
+        skipWhitespace();
+        if (_pos == _input.size())
+            return left;
+        const char op = _input[_pos];
+        const int opPrecedence = precedence(op);
+        if (opPrecedence == 0) {
+            if (op == ')' || op == ';' || op == ',')
+                return left;
+            if (op == '=')
+                return fail("unexpected '=', separate assignments with ';'");
+            return fail("expected an operator");
+        }
+        if (opPrecedence < minPrecedence)
+            return left;
+        _pos++;
+        // All operators are left associative, so the right operand only
+        // takes operators binding stronger than op.
+        Node* right = parseExpression(opPrecedence + 1);
+        if (!right)
+            return nullptr;
+        Node* node = newNode(nodeTypeFromOperator(op));
+        node->left = left;
+        node->right = right;
+        left = node;
     }
+}
+
+Parser::Node* Parser::parseAssignment() {
+    skipWhitespace();
+    const size_t assignPos = _input.find('=', _pos);
+    if (assignPos == string_view::npos || assignPos > _input.find(';', _pos))
+        return fail("expected '=' after the output file path");
 
-    _root.right = right;
+    Node* assignment = newNode(Node::ASSIGN);
+    Node* output = newNode(Node::OUTPUTFILEPATH);
+    output->path = trim(string(_input.substr(_pos, assignPos - _pos)));
+    const size_t partPos = output->path.rfind('[');
+    if (!output->path.empty() && output->path.back() == ']' && partPos != string::npos) {
+        output->part = trim(output->path.substr(partPos + 1, output->path.size() - partPos - 2));
+        output->path = trim(output->path.substr(0, partPos));
+        if (output->part.empty()) {
+            _pos += partPos + 1;
+            return fail("expected a part name");
+        }
+    }
+    if (output->path.empty())
+        return fail("expected an output file path");
+
+    _pos = assignPos + 1;
+    Node* right = parseExpression(1);
+    if (!right)
+        return nullptr;
+    skipWhitespace();
+    if (_pos != _input.size() && _input[_pos] != ';')
+        return fail(string("unexpected '") + _input[_pos] + "'");
+
+    assignment->left = output;
+    assignment->right = right;
+    return assignment;
+}
+
+Parser::Parser(string exp)
+    :_expression(exp), _pos(0), _isValid(false) {
+    _input = _expression;
+    do {
+        Node* assignment = parseAssignment();
+        if (!assignment) {
+            // parsing failed. _errorMessage already contains reason.
+            return;
+        }
+        _assignments.push_back(assignment);
+        // Skip the ';' separating assignments, a trailing one is allowed.
+        if (_pos < _input.size())
+            _pos++;
+        skipWhitespace();
+    } while (_pos < _input.size());
     _isValid = true;
-}
\ No newline at end of file
+}
@@ -1,40 +1,49 @@
 #pragma once
 
 #include <array>
+#include <deque>
 #include <filesystem>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Parser {
 public:
     struct Node {
-        enum NodeType { INVALID, INPUTFILEPATH, OUTPUTFILEPATH, CONSTANT, ADD, SUB, MULT, DIV, ASSIGN };
-        Node() : type(INVALID), path(""), constant(0.0f), left(nullptr), right(nullptr) {}
-        ~Node() { if (left) delete left; if (right) delete right; }
+        enum NodeType { INVALID, INPUTFILEPATH, OUTPUTFILEPATH, CONSTANT, ADD, SUB, MULT, DIV, ASSIGN,
+                        MIN, MAX, CLAMP, POW, LERP, OVER };
+        Node() : type(INVALID), path(""), part(""), channel(""), constant(0.0f), left(nullptr), right(nullptr) {}
         std::string toString(const std::string& patch = "") const;
         void evaluate(std::function<void(const Parser::Node* node)>& lambda) const;
+        // Returns true and sets value if the subtree contains no file paths.
+        bool isConstant(float& value) const;
         NodeType type;
         std::string path;
+        // Name of the part in a multi-part file ("file.exr[part]"), empty
+        // for the whole file.
+        std::string part;
+        // Channel selected from an input ("file.exr.A"), empty for all.
+        std::string channel;
         float constant;
+        // Children are owned by the Parser that created them.
         Node* left;
         Node* right;
-    };
+        // Arguments of function nodes (MIN to OVER), in order.
+        std::vector<Node*> arguments;
 
-    struct Token {
-        enum TokenType { FILEPATH, CONSTANT, ADD, SUB, MULT, DIV, SUBTERM };
-        Token(TokenType type, std::string s) : type(type), s(s) {}
-        Token(char operation);
-        bool isAddOrSub() const { return type == ADD || type == SUB; }
-        bool isMultOrDiv() const { return type == MULT || type == DIV; }
-        bool isOperator() const { return isAddOrSub() || isMultOrDiv(); }
-        TokenType type;
-        std::string s;
+    private:
+        void appendTo(std::string& s, const std::string& patch) const;
     };
 
-    // Creates a new parser object and parses expression.
+    // Creates a new parser object and parses expression, which holds one
+    // or more assignments separated by ';'.
     Parser(std::string expression);
 
+    // Nodes point into the parser's node storage, so parsers can't be copied.
+    Parser(const Parser&) = delete;
+    Parser& operator=(const Parser&) = delete;
+
     // Returns whether the parsed expression was valid.
     bool isValid() const { return _isValid; }
 
@@ -42,16 +51,42 @@ public:
     // could not be parsed.
     std::string getErrorMessage() const { return _errorMessage; }
 
-    // If isValid(), this returns the root node of type ASSIGN.
-    const Node* getRoot() const { return &_root; }
+    // If isValid(), this returns the root nodes of type ASSIGN, one per
+    // assignment in order of appearance.
+    const std::vector<const Node*>& getAssignments() const { return _assignments; }
 
 private:
+    // Parses "output = expression" up to the next ';' or the end.
+    Node* parseAssignment();
+    // Parses a chain of operands joined by operators binding at least as
+    // strong as minPrecedence (precedence climbing).
+    Node* parseExpression(int minPrecedence);
+    // Parses a constant, a file path, a function call or a parenthesized
+    // expression.
+    Node* parseOperand();
+    // Parses the arguments of a call to a function of the given type,
+    // starting at the opening '('.
+    Node* parseFunction(Node::NodeType type, const std::string& name);
+    // Returns the length of the file path or pipe starting at _pos, or 0 if
+    // there is none.
+    size_t scanPath() const;
+    // Parses an optional "[part]" suffix following a file path into node.
+    bool parsePart(Node* node);
+    // Returns true if a file path may end right before pos.
+    bool isPathEnd(size_t pos) const;
+    void skipWhitespace();
+    Node* newNode(Node::NodeType type);
+    // Sets the error message, pointing at the current position.
+    Node* fail(const std::string& message);
 
-    Node* parse(std::string s);
-    Node* parse(std::vector<Parser::Token> serialized);
-    std::vector<Parser::Token> serializeOperandsAndParentheses(std::string s);
-    Node _root;
+    std::string _expression;
+    std::string_view _input;
+    size_t _pos;
+    // Arena all nodes are allocated from. A deque never moves its
+    // elements, so node pointers stay valid while it grows.
+    std::deque<Node> _nodes;
+    std::vector<const Node*> _assignments;
 
     bool _isValid;
     std::string _errorMessage;
-};
\ No newline at end of file
+};
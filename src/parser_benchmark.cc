@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "parser.h"
+
+using namespace std;
+
+// Times parsing and printing long expressions. Parsing is linear in the
+// length of the expression, so the time per term should stay roughly
+// constant as the number of terms doubles.
+
+// Returns "out.exr = aov_0.exr + aov_1.exr * aov_2.exr ..." with count terms.
+string flatExpression(int count) {
+    string expression = "out.exr = ";
+    for (int i = 0; i < count; i++) {
+        if (i > 0)
+            expression += i % 3 ? " + " : " * ";
+        expression += "aov_" + to_string(i) + ".exr";
+    }
+    return expression;
+}
+
+// Returns "out.exr = aov_0.exr + (aov_1.exr + (aov_2.exr + (...)))" with count
+// terms.
+string nestedExpression(int count) {
+    string expression = "out.exr = ";
+    for (int i = 0; i < count; i++) {
+        if (i > 0)
+            expression += " + (";
+        expression += "aov_" + to_string(i) + ".exr";
+    }
+    expression += string(count - 1, ')');
+    return expression;
+}
+
+// Returns the average milliseconds to parse and print expression.
+double timeParse(const string& expression, int repetitions) {
+    const auto start = chrono::steady_clock::now();
+    size_t length = 0;
+    for (int i = 0; i < repetitions; i++) {
+        Parser parser(expression);
+        if (!parser.isValid()) {
+            cout << "error parsing expression: " << parser.getErrorMessage() << "\n";
+            exit(1);
+        }
+        length += parser.getAssignments().front()->toString("").size();
+    }
+    const double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    // Keeps the printing from being optimized away.
+    if (length == 0)
+        cout << "";
+    return milliseconds / repetitions;
+}
+
+int main(int argc, char** argv) {
+    const int repetitions = argc > 1 ? atoi(argv[1]) : 20;
+    cout << "terms\tflat ms\tnested ms\n";
+    for (int count : {1000, 2000, 4000, 8000}) {
+        const double flat = timeParse(flatExpression(count), repetitions);
+        const double nested = timeParse(nestedExpression(count), repetitions);
+        cout << count << "\t" << flat << "\t" << nested << "\n";
+    }
+    return 0;
+}
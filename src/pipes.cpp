@@ -0,0 +1,94 @@
+#include "pipes.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const string kPipePrefix = "pipe:";
+
+#ifdef _WIN32
+void setBinaryMode(int fd) { _setmode(fd, _O_BINARY); }
+long long readDescriptor(int fd, char* data, size_t size) { return _read(fd, data, unsigned(size)); }
+long long writeDescriptor(int fd, const char* data, size_t size) { return _write(fd, data, unsigned(size)); }
+#else
+void setBinaryMode(int) {}
+long long readDescriptor(int fd, char* data, size_t size) { return read(fd, data, size); }
+long long writeDescriptor(int fd, const char* data, size_t size) { return write(fd, data, size); }
+#endif
+
+// Size of the blocks pipes are read and written in.
+const size_t kBlockSize = 1 << 20;
+
+}  // namespace
+
+bool isPipePath(const string& path) {
+    if (path == "-")
+        return true;
+    if (path.compare(0, kPipePrefix.size(), kPipePrefix) != 0)
+        return false;
+    for (size_t i = kPipePrefix.size(); i < path.size(); i++) {
+        if (!isdigit((unsigned char)path[i]))
+            return false;
+    }
+    return true;
+}
+
+int pipeDescriptor(const string& path, bool isOutput) {
+    if (path == "-" || path == kPipePrefix)
+        return isOutput ? 1 : 0;
+    return atoi(path.c_str() + kPipePrefix.size());
+}
+
+shared_ptr<const vector<char>> readPipe(const string& path) {
+    static mutex pipesMutex;
+    static map<int, shared_ptr<const vector<char>>> pipes;
+
+    const int fd = pipeDescriptor(path, false);
+    lock_guard<mutex> lock(pipesMutex);
+    auto found = pipes.find(fd);
+    if (found != pipes.end())
+        return found->second;
+
+    // Exr files need random access, so the whole stream is buffered.
+    setBinaryMode(fd);
+    auto data = make_shared<vector<char>>();
+    while (true) {
+        const size_t size = data->size();
+        data->resize(size + kBlockSize);
+        const long long received = readDescriptor(fd, data->data() + size, kBlockSize);
+        if (received < 0)
+            throw runtime_error("cannot read from " + path);
+        data->resize(size + size_t(received));
+        if (received == 0)
+            break;
+    }
+    pipes[fd] = data;
+    return data;
+}
+
+void writePipe(const string& path, const vector<char>& data) {
+    const int fd = pipeDescriptor(path, true);
+    setBinaryMode(fd);
+    size_t written = 0;
+    while (written < data.size()) {
+        const size_t size = min(kBlockSize, data.size() - written);
+        const long long result = writeDescriptor(fd, data.data() + written, size);
+        if (result <= 0)
+            throw runtime_error("cannot write to " + path);
+        written += size_t(result);
+    }
+}
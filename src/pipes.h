@@ -0,0 +1,25 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Inputs and outputs can be pipes instead of files, to chain the composer
+// with other tools without temporary files:
+//   "pipe:"   standard input (as input) or standard output (as output)
+//   "pipe:N"  file descriptor N
+//   "-"       standard output, only valid as output
+
+// Returns true if path refers to a pipe instead of a file.
+bool isPipePath(const std::string& path);
+
+// Returns the file descriptor a pipe path refers to.
+int pipeDescriptor(const std::string& path, bool isOutput);
+
+// Returns the complete contents of an input pipe. Pipes can only be read
+// once, so the contents are read on first use and kept for later calls.
+// Throws if the pipe cannot be read.
+std::shared_ptr<const std::vector<char>> readPipe(const std::string& path);
+
+// Writes data to an output pipe. Throws if the pipe cannot be written.
+void writePipe(const std::string& path, const std::vector<char>& data);
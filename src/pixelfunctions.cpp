@@ -0,0 +1,108 @@
+#include "pixelfunctions.h"
+
+#include <algorithm>
+#undef NDEBUG  // keep assertions in release builds.
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+struct ArrayOperand {
+    const float* values;
+    float operator[](size_t i) const { return values[i]; }
+};
+
+struct ConstantOperand {
+    float constant;
+    float operator[](size_t) const { return constant; }
+};
+
+// Calls kernel with the first N operands as ArrayOperand or ConstantOperand.
+// Every combination gets its own instance of the kernel loop, so the loops
+// have no per value branches and can be vectorized by the compiler.
+template <size_t N, class Kernel, class... Resolved>
+void withOperands(const PixelOperand* operands, Kernel& kernel, Resolved... resolved) {
+    if constexpr (sizeof...(Resolved) == N) {
+        kernel(resolved...);
+    } else {
+        const PixelOperand& operand = operands[sizeof...(Resolved)];
+        if (operand.values)
+            withOperands<N>(operands, kernel, resolved..., ArrayOperand{operand.values});
+        else
+            withOperands<N>(operands, kernel, resolved..., ConstantOperand{operand.constant});
+    }
+}
+
+}  // namespace
+
+void applyPixelFunction(Parser::Node::NodeType type,
+                        const vector<PixelOperand>& operands,
+                        float* result,
+                        size_t count,
+                        int stride) {
+    switch (type) {
+        case Parser::Node::MIN: {
+            assert(operands.size() == 2);
+            auto kernel = [&](auto a, auto b) {
+                for (size_t i = 0; i < count; i++)
+                    result[i] = std::min(a[i], b[i]);
+            };
+            withOperands<2>(operands.data(), kernel);
+            return;
+        }
+        case Parser::Node::MAX: {
+            assert(operands.size() == 2);
+            auto kernel = [&](auto a, auto b) {
+                for (size_t i = 0; i < count; i++)
+                    result[i] = std::max(a[i], b[i]);
+            };
+            withOperands<2>(operands.data(), kernel);
+            return;
+        }
+        case Parser::Node::CLAMP: {
+            assert(operands.size() == 3);
+            auto kernel = [&](auto x, auto low, auto high) {
+                for (size_t i = 0; i < count; i++)
+                    result[i] = std::min(std::max(x[i], low[i]), high[i]);
+            };
+            withOperands<3>(operands.data(), kernel);
+            return;
+        }
+        case Parser::Node::POW: {
+            assert(operands.size() == 2);
+            auto kernel = [&](auto base, auto exponent) {
+                for (size_t i = 0; i < count; i++)
+                    result[i] = std::pow(base[i], exponent[i]);
+            };
+            withOperands<2>(operands.data(), kernel);
+            return;
+        }
+        case Parser::Node::LERP: {
+            assert(operands.size() == 3);
+            auto kernel = [&](auto a, auto b, auto t) {
+                for (size_t i = 0; i < count; i++)
+                    result[i] = a[i] + (b[i] - a[i]) * t[i];
+            };
+            withOperands<3>(operands.data(), kernel);
+            return;
+        }
+        case Parser::Node::OVER: {
+            // Premultiplied foreground over background: fg + bg * (1 - fg.A).
+            assert(operands.size() == 2 && operands[0].values && stride == 4);
+            const float* foreground = operands[0].values;
+            auto kernel = [&](auto background) {
+                for (size_t i = 0; i < count; i += 4) {
+                    const float transparency = 1.0f - foreground[i + 3];
+                    for (size_t c = 0; c < 4; c++)
+                        result[i + c] = foreground[i + c] + background[i + c] * transparency;
+                }
+            };
+            withOperands<1>(operands.data() + 1, kernel);
+            return;
+        }
+        default:
+            assert(false);
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "parser.h"
+
+// Operand of a pixel function: interleaved RGB(A) values, or a constant
+// used for every value.
+struct PixelOperand {
+    const float* values = nullptr;  // nullptr for constants.
+    float constant = 0.0f;
+};
+
+// Applies the function of node type (MIN to OVER) to count interleaved
+// RGB(A) values with the given stride and stores them in result. The
+// functions work per value, except for OVER, whose first operand must be
+// an array of RGBA values (stride 4).
+void applyPixelFunction(Parser::Node::NodeType type,
+                        const std::vector<PixelOperand>& operands,
+                        float* result,
+                        size_t count,
+                        int stride);
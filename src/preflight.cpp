@@ -0,0 +1,145 @@
+#include "preflight.h"
+
+#include <algorithm>
+#include <execution>
+#include <exception>
+#include <set>
+
+#include <OpenEXR/IlmImf/ImfChannelList.h>
+
+#include "exrio.h"
+
+using namespace std;
+using namespace OPENEXR_IMF_NAMESPACE;
+using namespace IMATH_NAMESPACE;
+
+namespace {
+
+// Files kept open for decoding. Beyond this, files are closed after their
+// header has been read to stay clear of the C runtime's open file limit.
+const size_t kMaxOpenFiles = 256;
+
+// Stop listing problems after this many, large sequences tend to fail the
+// same way for every frame.
+const size_t kMaxReportedProblems = 100;
+
+string resolutionString(const Header& header) {
+    const Box2i dw = header.dataWindow();
+    return to_string(dw.max.x - dw.min.x + 1) + "x" + to_string(dw.max.y - dw.min.y + 1);
+}
+
+}  // namespace
+
+bool Preflight::run(const vector<vector<string>>& inputsPerFrame,
+                    const vector<vector<int>>& alphaGroupsPerFrame,
+                    const vector<string>& frameNames,
+                    bool readAlpha,
+                    const set<string>& inputsNeedingAlpha,
+                    const Box2i* region,
+                    ostream& out) {
+    set<string> uniquePaths;
+    for (const vector<string>& frameInputs : inputsPerFrame)
+        uniquePaths.insert(frameInputs.begin(), frameInputs.end());
+    vector<Input> inputs;
+    for (const string& path : uniquePaths) {
+        inputs.push_back(Input());
+        inputs.back().path = path;
+    }
+
+    std::for_each(
+        std::execution::par,
+        inputs.begin(),
+        inputs.end(),
+        [&](Input& input)
+        {
+            try {
+                input.file = openInputImage(input.path);
+                input.header = input.file->header();
+                if (size_t(&input - inputs.data()) >= kMaxOpenFiles)
+                    input.file.reset();
+            }
+            catch (const exception& e) {
+                input.file.reset();
+                input.errorMessage = e.what();
+            }
+        });
+
+    map<string, const Input*> inputsByPath;
+    vector<string> problems;
+    for (Input& input : inputs) {
+        inputsByPath[input.path] = &input;
+        if (!input.errorMessage.empty()) {
+            problems.push_back(input.path + " cannot be read: " + input.errorMessage);
+            continue;
+        }
+        for (const char* channel : {"R", "G", "B"}) {
+            if (!input.header.channels().findChannel(channel))
+                problems.push_back(input.path + " has no " + channel + " channel.");
+        }
+        if (inputsNeedingAlpha.count(input.path) && !input.header.channels().findChannel("A"))
+            problems.push_back(input.path + " has no A channel, but it is selected with .A or used as foreground of over.");
+        if (region && !windowContains(input.header.dataWindow(), *region)) {
+            problems.push_back(input.path + ": region " + windowString(*region) + " is outside its data window " +
+                               windowString(input.header.dataWindow()) + ".");
+        }
+    }
+
+    for (size_t i = 0; i < inputsPerFrame.size(); i++) {
+        const Input* reference = nullptr;
+        map<int, const Input*> alphaReferences;
+        for (size_t j = 0; j < inputsPerFrame[i].size(); j++) {
+            const Input* input = inputsByPath[inputsPerFrame[i][j]];
+            if (!input->errorMessage.empty())
+                continue;
+            const int alphaGroup = alphaGroupsPerFrame[i][j];
+            if (readAlpha && alphaGroup >= 0) {
+                const Input*& alphaReference = alphaReferences[alphaGroup];
+                if (!alphaReference)
+                    alphaReference = input;
+                const bool referenceHasAlpha = alphaReference->header.channels().findChannel("A") != nullptr;
+                const bool inputHasAlpha = input->header.channels().findChannel("A") != nullptr;
+                if (referenceHasAlpha != inputHasAlpha) {
+                    problems.push_back(frameNames[i] + ": alpha mismatch. " +
+                                       (referenceHasAlpha ? alphaReference->path : input->path) + " has an alpha channel, " +
+                                       (referenceHasAlpha ? input->path : alphaReference->path) + " does not. " +
+                                       "Consider using -rgb argument to ignore alpha channels altogether.");
+                }
+            }
+            if (!reference) {
+                reference = input;
+                continue;
+            }
+            if (resolutionString(input->header) != resolutionString(reference->header)) {
+                problems.push_back(frameNames[i] + ": resolution mismatch. " +
+                                   reference->path + " is " + resolutionString(reference->header) + " and " +
+                                   input->path + " is " + resolutionString(input->header) + ".");
+            }
+        }
+    }
+
+    if (!problems.empty()) {
+        out << "error: preflight found " << problems.size() << " problems, nothing has been computed:\n";
+        for (size_t i = 0; i < problems.size() && i < kMaxReportedProblems; i++)
+            out << problems[i] << "\n";
+        if (problems.size() > kMaxReportedProblems)
+            out << "... and " << problems.size() - kMaxReportedProblems << " more.\n";
+        return false;
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    for (Input& input : inputs) {
+        if (input.file)
+            _openFiles[input.path] = input.file;
+    }
+    return true;
+}
+
+shared_ptr<InputImage> Preflight::take(const string& name) {
+    lock_guard<mutex> lock(_mutex);
+    auto found = _openFiles.find(name);
+    if (found == _openFiles.end())
+        return nullptr;
+    shared_ptr<InputImage> file = found->second;
+    _openFiles.erase(found);
+    return file;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <OpenEXR/IlmImf/ImfHeader.h>
+#include <OpenEXR/IlmImf/ImfNamespace.h>
+
+#include "exrio.h"
+
+// Validates the headers of all inputs of a job before any pixels are
+// decoded, so broken sequences fail in seconds instead of after hours.
+// Files opened for validation are kept open to be reused for decoding.
+class Preflight {
+public:
+    // Opens all inputs in parallel, reading headers only, and checks that
+    // the inputs of every frame can be composed: all files are readable,
+    // contain R, G and B channels, have the same resolution and, unless
+    // alpha is ignored, either all or none of the inputs of an alpha group
+    // have an alpha channel.
+    // Inputs in inputsNeedingAlpha must have an alpha channel in any case.
+    // If region is given, it must lie inside the data window of all inputs.
+    // inputsPerFrame holds the input image names (see imageName) of each
+    // frame, alphaGroupsPerFrame the alpha group of each of them, -1 for
+    // inputs exempt from the alpha check. frameNames holds the
+    // corresponding outputs used for reporting. All problems are reported
+    // to out. Returns false if there were any.
+    bool run(const std::vector<std::vector<std::string>>& inputsPerFrame,
+             const std::vector<std::vector<int>>& alphaGroupsPerFrame,
+             const std::vector<std::string>& frameNames,
+             bool readAlpha,
+             const std::set<std::string>& inputsNeedingAlpha,
+             const IMATH_NAMESPACE::Box2i* region,
+             std::ostream& out);
+
+    // Hands over the image opened for name during run(), if it is still
+    // open. Every image is handed out once, returns nullptr otherwise.
+    std::shared_ptr<InputImage> take(const std::string& name);
+
+private:
+    struct Input {
+        std::string path;
+        std::shared_ptr<InputImage> file;
+        OPENEXR_IMF_NAMESPACE::Header header;
+        std::string errorMessage;  // empty if the header could be read.
+    };
+
+    std::mutex _mutex;
+    std::map<std::string, std::shared_ptr<InputImage>> _openFiles;
+};
@@ -0,0 +1,222 @@
+#include "server.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <streambuf>
+#include <thread>
+
+#include "options.h"
+
+using namespace std;
+
+// Wire format:
+// A request is the number of strings in decimal followed by '\n', then the
+// strings each terminated by '\0'. The first string is the working directory
+// of the client, the remaining ones are the job arguments.
+// The response is the progress output of the job, followed by '\0', the exit
+// code in decimal and '\n'.
+
+namespace {
+
+// Stream buffer sending everything written to it over a socket. Frames of a
+// job are computed in parallel, so writes are serialized and forwarded line
+// by line to stream progress as soon as it is available.
+class SocketStreamBuf : public streambuf {
+public:
+    explicit SocketStreamBuf(LocalSocket& socket) : _socket(socket), _connected(true) {}
+
+protected:
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+        const char ch = traits_type::to_char_type(c);
+        xsputn(&ch, 1);
+        return c;
+    }
+
+    streamsize xsputn(const char* s, streamsize n) override {
+        lock_guard<mutex> lock(_mutex);
+        _pending.append(s, size_t(n));
+        if (_pending.find_first_of("\n\r") != string::npos)
+            flushPending();
+        return n;
+    }
+
+    int sync() override {
+        lock_guard<mutex> lock(_mutex);
+        flushPending();
+        return _connected ? 0 : -1;
+    }
+
+private:
+    void flushPending() {
+        if (_connected && !_pending.empty())
+            _connected = _socket.sendAll(_pending.data(), _pending.size());
+        _pending.clear();
+    }
+
+    LocalSocket& _socket;
+    mutex _mutex;
+    string _pending;
+    bool _connected;
+};
+
+// Reads '\0' terminated strings from a socket.
+class MessageReader {
+public:
+    explicit MessageReader(LocalSocket& socket) : _socket(socket), _pos(0) {}
+
+    // Reads up to and excluding terminator. Returns false if the connection
+    // was closed before the terminator arrived.
+    bool readUntil(char terminator, string& result) {
+        result.clear();
+        while (true) {
+            size_t end = _buffer.find(terminator, _pos);
+            if (end != string::npos) {
+                result = _buffer.substr(_pos, end - _pos);
+                _pos = end + 1;
+                return true;
+            }
+            _buffer.erase(0, _pos);
+            _pos = 0;
+            char chunk[4096];
+            long long received = _socket.receive(chunk, sizeof(chunk));
+            if (received <= 0)
+                return false;
+            _buffer.append(chunk, size_t(received));
+        }
+    }
+
+private:
+    LocalSocket& _socket;
+    string _buffer;
+    size_t _pos;
+};
+
+}  // namespace
+
+ComposeServer::ComposeServer(const string& socketPath, size_t frameCacheBytes, int maxConcurrentJobs)
+    : _socketPath(socketPath),
+      _composer(frameCacheBytes),
+      _freeJobSlots(max(1, maxConcurrentJobs)) {}
+
+int ComposeServer::run(ostream& log) {
+    LocalSocket listener;
+    string errorMessage;
+    if (!listener.listen(_socketPath, errorMessage)) {
+        log << "error: " << errorMessage << "\n";
+        return 1;
+    }
+    log << "listening on " << _socketPath << "\n";
+    while (true) {
+        LocalSocket connection = listener.accept();
+        if (!connection.isValid())
+            continue;
+        thread(&ComposeServer::handleConnection, this, std::move(connection)).detach();
+    }
+}
+
+void ComposeServer::handleConnection(LocalSocket connection) {
+    MessageReader reader(connection);
+    string countString;
+    if (!reader.readUntil('\n', countString))
+        return;
+    const int count = atoi(countString.c_str());
+    if (count < 1)
+        return;
+    string workingDirectory;
+    vector<string> args;
+    for (int i = 0; i < count; i++) {
+        string arg;
+        if (!reader.readUntil('\0', arg))
+            return;
+        if (i == 0)
+            workingDirectory = arg;
+        else
+            args.push_back(arg);
+    }
+
+    SocketStreamBuf streamBuf(connection);
+    ostream out(&streamBuf);
+    int exitCode = 1;
+    ComposeOptions options;
+    string errorMessage;
+    if (!parseComposeOptions(args, options, errorMessage)) {
+        out << errorMessage << "\n";
+    } else if (options.showHelp) {
+        out << "help is not available from the server, run without --server.\n";
+    } else {
+        options.workingDirectory = workingDirectory;
+        // The server can't reach the standard streams of its clients.
+        options.allowPipes = false;
+        {
+            unique_lock<mutex> lock(_jobMutex);
+            if (_freeJobSlots == 0) {
+                out << "waiting for other jobs to finish...\n";
+                _jobFinished.wait(lock, [this]() { return _freeJobSlots > 0; });
+            }
+            _freeJobSlots--;
+        }
+        try {
+            exitCode = _composer.compose(options, out);
+        }
+        catch (const exception& e) {
+            out << "error: " << e.what() << "\n";
+        }
+        {
+            lock_guard<mutex> lock(_jobMutex);
+            _freeJobSlots++;
+        }
+        _jobFinished.notify_one();
+    }
+    out.flush();
+    const string status = string(1, '\0') + to_string(exitCode) + "\n";
+    connection.sendAll(status.data(), status.size());
+}
+
+int runComposeClient(const string& socketPath, const vector<string>& args, ostream& out) {
+    LocalSocket connection;
+    string errorMessage;
+    if (!connection.connect(socketPath, errorMessage)) {
+        out << "error: " << errorMessage << "\n";
+        return 1;
+    }
+    string request = to_string(args.size() + 1) + "\n";
+    request += filesystem::current_path().string();
+    request.push_back('\0');
+    for (const string& arg : args) {
+        request += arg;
+        request.push_back('\0');
+    }
+    if (!connection.sendAll(request.data(), request.size())) {
+        out << "error: lost connection to server.\n";
+        return 1;
+    }
+
+    // Forward progress as it arrives, until the '\0' preceding the exit code.
+    string status;
+    char chunk[4096];
+    while (true) {
+        long long received = connection.receive(chunk, sizeof(chunk));
+        if (received <= 0) {
+            out << "error: lost connection to server.\n";
+            return 1;
+        }
+        const char* end = (const char*)memchr(chunk, '\0', size_t(received));
+        if (end) {
+            out.write(chunk, end - chunk);
+            status.assign(end + 1, size_t(chunk + received - (end + 1)));
+            break;
+        }
+        out.write(chunk, received);
+        out.flush();
+    }
+    while (status.find('\n') == string::npos) {
+        long long received = connection.receive(chunk, sizeof(chunk));
+        if (received <= 0)
+            return 1;
+        status.append(chunk, size_t(received));
+    }
+    return atoi(status.c_str());
+}
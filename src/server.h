@@ -0,0 +1,38 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "composer.h"
+#include "localsocket.h"
+
+// Long running composer that accepts jobs on a local socket. Jobs share one
+// Composer, so decoded frames and directory listings stay warm between them.
+class ComposeServer {
+public:
+    ComposeServer(const std::string& socketPath, size_t frameCacheBytes, int maxConcurrentJobs);
+
+    // Listens for jobs until the process is terminated. Returns the exit code
+    // if the server could not be started.
+    int run(std::ostream& log);
+
+private:
+    void handleConnection(LocalSocket connection);
+
+    std::string _socketPath;
+    Composer _composer;
+
+    // Limits the number of jobs evaluated at the same time, since every job
+    // already parallelizes over its frames.
+    std::mutex _jobMutex;
+    std::condition_variable _jobFinished;
+    int _freeJobSlots;
+};
+
+// Sends a job (the expression followed by its arguments) to the server
+// listening on socketPath and prints its progress to out.
+// Returns the exit code of the job.
+int runComposeClient(const std::string& socketPath, const std::vector<std::string>& args, std::ostream& out);
@@ -0,0 +1,66 @@
+#include "sharding.h"
+
+#include <algorithm>
+#undef NDEBUG  // keep assertions in release builds.
+#include <cassert>
+#include <cctype>
+
+using namespace std;
+
+bool parseFrameNumber(const string& patch, long long& frameNumber) {
+    if (patch.empty() || patch.size() > 18)
+        return false;
+    frameNumber = 0;
+    for (char c : patch) {
+        if (!isdigit((unsigned char)c))
+            return false;
+        frameNumber = frameNumber * 10 + (c - '0');
+    }
+    return true;
+}
+
+vector<string> sortPatches(const set<string>& patches) {
+    vector<string> sorted(patches.begin(), patches.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const string& a, const string& b) {
+        long long frameA, frameB;
+        const bool aIsFrame = parseFrameNumber(a, frameA);
+        const bool bIsFrame = parseFrameNumber(b, frameB);
+        if (aIsFrame && bIsFrame)
+            return frameA < frameB;
+        // numeric patches go first, the rest keeps lexicographic set order.
+        return aIsFrame && !bIsFrame;
+    });
+    return sorted;
+}
+
+vector<string> selectShard(const vector<string>& sortedPatches,
+                           const vector<uintmax_t>& weights,
+                           int shardIndex,
+                           int shardCount) {
+    assert(shardCount > 0 && shardIndex >= 0 && shardIndex < shardCount);
+    const size_t n = sortedPatches.size();
+    if (weights.empty()) {
+        const size_t begin = n * shardIndex / shardCount;
+        const size_t end = n * (shardIndex + 1) / shardCount;
+        return vector<string>(sortedPatches.begin() + begin, sortedPatches.begin() + end);
+    }
+
+    assert(weights.size() == n);
+    long double total = 0;
+    for (uintmax_t w : weights)
+        total += w;
+    vector<string> result;
+    long double before = 0;
+    for (size_t i = 0; i < n; i++) {
+        // A patch belongs to the shard its weight midpoint falls into.
+        int shard = i * shardCount / n;
+        if (total > 0) {
+            const long double midpoint = before + weights[i] / 2.0L;
+            shard = min(shardCount - 1, int(midpoint * shardCount / total));
+        }
+        if (shard == shardIndex)
+            result.push_back(sortedPatches[i]);
+        before += weights[i];
+    }
+    return result;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+// Parses a wildcard patch as frame number. Returns false if the patch is
+// not a (non-negative) integer.
+bool parseFrameNumber(const std::string& patch, long long& frameNumber);
+
+// Returns patches in processing order: numeric patches ordered by frame
+// number first, followed by all other patches in lexicographic order.
+std::vector<std::string> sortPatches(const std::set<std::string>& patches);
+
+// Returns the contiguous part of sortedPatches processed by shard shardIndex
+// of shardCount. If weights is empty, every shard gets the same number of
+// patches. Otherwise weights holds a weight per patch (e.g. the input bytes)
+// and shards are balanced by their total weight.
+std::vector<std::string> selectShard(const std::vector<std::string>& sortedPatches,
+                                     const std::vector<std::uintmax_t>& weights,
+                                     int shardIndex,
+                                     int shardCount);
@@ -5,9 +5,10 @@
 
 // Removes leading and trailing whitespace from string.
 std::string trim(const std::string& s) {
-    std::string tmp = s.substr(0, s.find_last_not_of(" ") + 1);
-    tmp = tmp.substr(tmp.find_first_not_of(" "));
-    return tmp;
+    size_t first = s.find_first_not_of(" ");
+    if (first == std::string::npos)
+        return "";
+    return s.substr(first, s.find_last_not_of(" ") + 1 - first);
 }
 
 // Splits string at delimiter into array.